@@ -0,0 +1,82 @@
+#!/bin/sh
+#
+# End to end latency and throughput of mtev without touch hardware.
+#
+# Starts Xorg with the dummy video driver and mtev on a uinput device,
+# then times frames from write() to their XI2 raw event, see
+# bench/mtbench.c. Needs root for uinput and the server, and the dummy
+# video driver (xserver-xorg-video-dummy).
+#
+# usage: bench/latency.sh [mtbench options]
+#
+# Run "make" and "make bench" first. MTEV_DISPLAY picks the display,
+# :9 by default. Extra driver options can be passed in MTEV_OPTIONS as
+# xorg.conf lines.
+
+top=$(cd "$(dirname "$0")/.." && pwd)
+
+# Called back by mtbench once the device exists: $2 is the work dir
+if [ "$1" = "--start-server" ]; then
+	dir=$2
+	cat >"$dir/xorg.conf" <<CONF
+Section "ServerFlags"
+	Option		"AutoAddDevices"	"off"
+	Option		"AutoAddGPU"		"off"
+EndSection
+
+Section "Device"
+	Identifier	"dummy"
+	Driver		"dummy"
+	VideoRam	16384
+EndSection
+
+Section "Screen"
+	Identifier	"screen"
+	Device		"dummy"
+	DefaultDepth	24
+	SubSection "Display"
+		Depth	24
+		Modes	"1024x768"
+	EndSubSection
+EndSection
+
+Section "InputDevice"
+	Identifier	"mtev bench"
+	Driver		"mtev"
+	Option		"Device"		"$MTBENCH_DEVICE"
+$MTEV_OPTIONS
+EndSection
+
+Section "ServerLayout"
+	Identifier	"bench"
+	Screen		"screen"
+	InputDevice	"mtev bench"	"CorePointer"
+EndSection
+CONF
+	Xorg "$DISPLAY" -config "$dir/xorg.conf" \
+		-modulepath "$dir/modules,/usr/lib/xorg/modules" \
+		-logfile "$dir/Xorg.log" -noreset -nolisten tcp \
+		>/dev/null 2>&1 &
+	echo $! >"$dir/xorg.pid"
+	exit 0
+fi
+
+if [ ! -f "$top/obj/mtev.so" ] || [ ! -x "$top/bin/mtbench" ]; then
+	echo "$0: run make and make bench first" >&2
+	exit 1
+fi
+
+dir=$(mktemp -d)
+trap '[ -f "$dir/xorg.pid" ] && kill $(cat "$dir/xorg.pid");
+      cp "$dir/Xorg.log" /tmp/mtbench-Xorg.log 2>/dev/null; rm -rf "$dir"' EXIT
+
+mkdir -p "$dir/modules/input"
+ln -s "$top/obj/mtev.so" "$dir/modules/input/mtev.so"
+
+DISPLAY=${MTEV_DISPLAY:-:9}
+export DISPLAY MTEV_OPTIONS
+
+"$top/bin/mtbench" -x "'$0' --start-server '$dir'" "$@"
+status=$?
+[ $status -ne 0 ] && echo "$0: server log in /tmp/mtbench-Xorg.log" >&2
+exit $status
@@ -0,0 +1,435 @@
+/***************************************************************************
+ *
+ * Multitouch protocol X driver
+ * Copyright (C) 2009,2010 Nokia Corporation
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ **************************************************************************/
+
+/*
+ * End to end latency of the driver: frames written to a uinput touch
+ * device, read by mtev in a headless X server, received by an XI2
+ * client. Run through bench/latency.sh, which starts the server.
+ *
+ * usage: mtbench [-n frames] [-r rate] [-b frames] [-x command]
+ *
+ * The uinput device is created first. Its node is passed to the -x
+ * command in MTBENCH_DEVICE, the command starts the server on $DISPLAY
+ * and returns. Then each of -n frames is written at -r frames per
+ * second and timed from write() to the XI_RawMotion event carrying it.
+ * Last -b frames are written back to back to measure throughput.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <linux/input.h>
+#include <linux/uinput.h>
+#include <X11/Xlib.h>
+#include <X11/extensions/XInput2.h>
+
+#define DEVICE_NAME "mtev bench"
+
+/* Frames are told apart by their x position */
+#define X_BASE  100
+#define X_RANGE 3000
+
+#define MAX_FRAMES 100000
+
+static int uinput = -1;
+static Display *dpy;
+static int xi_opcode;
+static int deviceid;
+
+static double latency_us[MAX_FRAMES];
+
+static double now_us(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+static void set_abs(struct uinput_user_dev *dev, int code, int max)
+{
+	ioctl(uinput, UI_SET_ABSBIT, code);
+	dev->absmin[code] = 0;
+	dev->absmax[code] = max;
+}
+
+/* Writes the node of the new device to path */
+static int find_node(char *path, size_t size)
+{
+	char name[64];
+	int tries;
+	int fd;
+	int i;
+
+	// udev may take a moment to create the node
+	for (tries = 0; tries < 50; tries++) {
+		for (i = 0; i < 64; i++) {
+			snprintf(path, size, "/dev/input/event%d", i);
+			fd = open(path, O_RDONLY);
+			if (fd < 0)
+				continue;
+
+			memset(name, 0, sizeof(name));
+			ioctl(fd, EVIOCGNAME(sizeof(name) - 1), name);
+			close(fd);
+			if (!strcmp(name, DEVICE_NAME))
+				return 0;
+		}
+		usleep(100000);
+	}
+
+	return -1;
+}
+
+static int create_device(char *path, size_t size)
+{
+	struct uinput_user_dev dev;
+
+	uinput = open("/dev/uinput", O_WRONLY);
+	if (uinput < 0) {
+		perror("/dev/uinput");
+		return -1;
+	}
+
+	memset(&dev, 0, sizeof(dev));
+	snprintf(dev.name, sizeof(dev.name), DEVICE_NAME);
+	dev.id.bustype = BUS_VIRTUAL;
+
+	ioctl(uinput, UI_SET_EVBIT, EV_SYN);
+	ioctl(uinput, UI_SET_EVBIT, EV_KEY);
+	ioctl(uinput, UI_SET_KEYBIT, BTN_TOUCH);
+	ioctl(uinput, UI_SET_EVBIT, EV_ABS);
+	set_abs(&dev, ABS_MT_POSITION_X, X_BASE + X_RANGE);
+	set_abs(&dev, ABS_MT_POSITION_Y, 2047);
+	set_abs(&dev, ABS_MT_TOUCH_MAJOR, 255);
+	set_abs(&dev, ABS_MT_TRACKING_ID, 9);
+
+	if (write(uinput, &dev, sizeof(dev)) != sizeof(dev) ||
+	    ioctl(uinput, UI_DEV_CREATE) < 0) {
+		perror("uinput");
+		return -1;
+	}
+
+	if (find_node(path, size)) {
+		fprintf(stderr, "mtbench: no node for the uinput device\n");
+		return -1;
+	}
+
+	return 0;
+}
+
+static void add_event(struct input_event *ev, int *n,
+		      int type, int code, int value)
+{
+	memset(&ev[*n], 0, sizeof(struct input_event));
+	ev[*n].type = type;
+	ev[*n].code = code;
+	ev[*n].value = value;
+	(*n)++;
+}
+
+/* One finger frame, or a lift when x is negative */
+static int write_frame(int x)
+{
+	struct input_event ev[8];
+	int n = 0;
+
+	if (x >= 0) {
+		add_event(ev, &n, EV_ABS, ABS_MT_TRACKING_ID, 0);
+		add_event(ev, &n, EV_ABS, ABS_MT_POSITION_X, x);
+		add_event(ev, &n, EV_ABS, ABS_MT_POSITION_Y, 1000);
+		add_event(ev, &n, EV_ABS, ABS_MT_TOUCH_MAJOR, 20);
+		add_event(ev, &n, EV_SYN, SYN_MT_REPORT, 0);
+	}
+	add_event(ev, &n, EV_KEY, BTN_TOUCH, x >= 0);
+	add_event(ev, &n, EV_SYN, SYN_REPORT, 0);
+
+	return write(uinput, ev, n * sizeof(struct input_event)) < 0 ? -1 : 0;
+}
+
+static int frame_x(int frame)
+{
+	return X_BASE + frame % X_RANGE;
+}
+
+static int find_device(void)
+{
+	XIDeviceInfo *info;
+	int num;
+	int id = -1;
+	int i;
+
+	info = XIQueryDevice(dpy, XIAllDevices, &num);
+	for (i = 0; i < num; i++)
+		if (!strcmp(info[i].name, DEVICE_NAME))
+			id = info[i].deviceid;
+	XIFreeDeviceInfo(info);
+
+	return id;
+}
+
+static int open_display(void)
+{
+	unsigned char bits[XIMaskLen(XI_LASTEVENT)] = { 0 };
+	XIEventMask mask;
+	int major = 2;
+	int minor = 2;
+	int event;
+	int error;
+	int tries;
+
+	for (tries = 0; tries < 100 && !dpy; tries++) {
+		dpy = XOpenDisplay(NULL);
+		if (!dpy)
+			usleep(100000);
+	}
+	if (!dpy) {
+		fprintf(stderr, "mtbench: cannot open display\n");
+		return -1;
+	}
+
+	if (!XQueryExtension(dpy, "XInputExtension", &xi_opcode,
+			     &event, &error) ||
+	    XIQueryVersion(dpy, &major, &minor) != Success) {
+		fprintf(stderr, "mtbench: no XInput 2\n");
+		return -1;
+	}
+
+	for (tries = 0; tries < 100 && deviceid < 0; tries++) {
+		deviceid = find_device();
+		if (deviceid < 0)
+			usleep(100000);
+	}
+	if (deviceid < 0) {
+		fprintf(stderr, "mtbench: %s not in the server\n",
+			DEVICE_NAME);
+		return -1;
+	}
+
+	// Raw events go to the root window, with nothing in between
+	XISetMask(bits, XI_RawMotion);
+	mask.deviceid = deviceid;
+	mask.mask_len = sizeof(bits);
+	mask.mask = bits;
+	XISelectEvents(dpy, DefaultRootWindow(dpy), &mask, 1);
+	XSync(dpy, False);
+
+	return 0;
+}
+
+/* x of the next raw motion from the device, -1 on timeout */
+static int wait_motion(int timeout_ms)
+{
+	struct pollfd pfd = { ConnectionNumber(dpy), POLLIN, 0 };
+	const double end = now_us() + timeout_ms * 1000.0;
+	XEvent ev;
+
+	for (;;) {
+		while (XPending(dpy)) {
+			XGenericEventCookie *cookie = &ev.xcookie;
+			int x = -1;
+
+			XNextEvent(dpy, &ev);
+			if (cookie->type != GenericEvent ||
+			    cookie->extension != xi_opcode ||
+			    !XGetEventData(dpy, cookie))
+				continue;
+
+			if (cookie->evtype == XI_RawMotion) {
+				XIRawEvent *raw = cookie->data;
+
+				// Valuator 0 is finger 0 x, sent as is
+				if (raw->sourceid == deviceid &&
+				    XIMaskIsSet(raw->valuators.mask, 0))
+					x = raw->raw_values[0];
+			}
+			XFreeEventData(dpy, cookie);
+
+			if (x >= 0)
+				return x;
+		}
+
+		if (now_us() >= end)
+			return -1;
+		poll(&pfd, 1, (end - now_us()) / 1000 + 1);
+	}
+}
+
+static int compare(const void *a, const void *b)
+{
+	const double da = *(const double *)a;
+	const double db = *(const double *)b;
+
+	return da < db ? -1 : da > db;
+}
+
+static double percentile(const double *sorted, int n, int p)
+{
+	return sorted[(n - 1) * p / 100];
+}
+
+/* Each frame timed on its own, at most rate frames per second */
+static int measure_latency(int frames, int rate)
+{
+	const double interval = rate > 0 ? 1e6 / rate : 0;
+	double next = now_us();
+	int lost = 0;
+	int n = 0;
+	int i;
+
+	for (i = 0; i < frames; i++) {
+		double start;
+		int x;
+
+		while (now_us() < next)
+			usleep((next - now_us()) / 2 + 1);
+		next += interval;
+
+		start = now_us();
+		if (write_frame(frame_x(i))) {
+			perror("write");
+			return -1;
+		}
+
+		do
+			x = wait_motion(1000);
+		while (x >= 0 && x != frame_x(i));
+
+		if (x < 0)
+			lost++;
+		else
+			latency_us[n++] = now_us() - start;
+	}
+
+	write_frame(-1);
+	XSync(dpy, False);
+
+	if (!n) {
+		fprintf(stderr, "mtbench: no frame arrived\n");
+		return -1;
+	}
+
+	qsort(latency_us, n, sizeof(double), compare);
+	printf("latency: %d frames, %d lost, us p50 %.0f p90 %.0f "
+	       "p99 %.0f max %.0f\n", n, lost,
+	       percentile(latency_us, n, 50), percentile(latency_us, n, 90),
+	       percentile(latency_us, n, 99), latency_us[n - 1]);
+	return 0;
+}
+
+/* Frames written back to back, counted as they arrive */
+static int measure_throughput(int frames)
+{
+	double start;
+	double end;
+	int received = 0;
+	int last = -1;
+	int i;
+
+	start = now_us();
+	for (i = 0; i < frames; i++) {
+		if (write_frame(frame_x(i))) {
+			perror("write");
+			return -1;
+		}
+	}
+
+	end = start;
+	while (last != frame_x(frames - 1)) {
+		last = wait_motion(1000);
+		if (last < 0)
+			break;
+		received++;
+		end = now_us();
+	}
+
+	write_frame(-1);
+	XSync(dpy, False);
+
+	printf("throughput: %d of %d frames in %.1f ms, %.0f frames/s\n",
+	       received, frames, (end - start) / 1000,
+	       end > start ? received * 1e6 / (end - start) : 0);
+	return 0;
+}
+
+int main(int argc, char *argv[])
+{
+	char path[64];
+	const char *command = NULL;
+	int frames = 1000;
+	int rate = 100;
+	int burst = 1000;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "b:n:r:x:")) != -1) {
+		switch (opt) {
+		case 'b':
+			burst = atoi(optarg);
+			break;
+		case 'n':
+			frames = atoi(optarg);
+			break;
+		case 'r':
+			rate = atoi(optarg);
+			break;
+		case 'x':
+			command = optarg;
+			break;
+		default:
+			fprintf(stderr, "usage: %s [-n frames] [-r rate] "
+				"[-b frames] [-x command]\n", argv[0]);
+			return 2;
+		}
+	}
+
+	if (frames < 1 || frames > MAX_FRAMES)
+		frames = 1000;
+
+	deviceid = -1;
+	if (create_device(path, sizeof(path)))
+		return 1;
+	printf("device: %s\n", path);
+
+	if (command) {
+		setenv("MTBENCH_DEVICE", path, 1);
+		if (system(command)) {
+			fprintf(stderr, "mtbench: %s failed\n", command);
+			return 1;
+		}
+	}
+
+	if (open_display())
+		return 1;
+
+	if (measure_latency(frames, rate))
+		return 1;
+	if (burst > 0 && measure_throughput(burst))
+		return 1;
+
+	ioctl(uinput, UI_DEV_DESTROY);
+	XCloseDisplay(dpy);
+	return 0;
+}
@@ -88,12 +88,40 @@ int caps_read(struct mtev_caps *caps, int fd)
 	SETABS(caps, position_x, absbits, ABS_MT_POSITION_X, fd);
 	SETABS(caps, position_y, absbits, ABS_MT_POSITION_Y, fd);
 	SETABS(caps, tracking_id, absbits, ABS_MT_TRACKING_ID, fd);
+	SETABS(caps, pressure, absbits, ABS_MT_PRESSURE, fd);
 
 	caps->has_mtdata = caps->has_position_x && caps->has_position_y;
 
 	return 0;
 }
 
+int caps_read_key(struct mtev_caps_key *key, int fd)
+{
+	int rc;
+
+	memset(key, 0, sizeof(struct mtev_caps_key));
+
+	SYSCALL(rc = ioctl(fd, EVIOCGID, &key->id));
+	if (rc < 0) {
+		xf86Msg(X_ERROR, "mtev: cannot read device id\n");
+		return rc;
+	}
+
+	// Not all devices have an unique id, leave it empty then
+	SYSCALL(rc = ioctl(fd, EVIOCGUNIQ(sizeof(key->uniq) - 1), key->uniq));
+	if (rc < 0)
+		key->uniq[0] = '\0';
+
+	return 0;
+}
+
+bool caps_key_equal(const struct mtev_caps_key *a,
+		    const struct mtev_caps_key *b)
+{
+	return !memcmp(&a->id, &b->id, sizeof(a->id)) &&
+		!strcmp(a->uniq, b->uniq);
+}
+
 void caps_output(const struct mtev_caps *caps)
 {
 	char line[1024];
@@ -110,6 +138,7 @@ void caps_output(const struct mtev_caps *caps)
 	ADDCAP(line, caps, tracking_id);
 	ADDCAP(line, caps, position_x);
 	ADDCAP(line, caps, position_y);
+	ADDCAP(line, caps, pressure);
 
 	xf86Msg(X_INFO, "mtev: caps:%s\n", line);
 	if (caps->has_touch_major)
@@ -140,4 +169,8 @@ void caps_output(const struct mtev_caps *caps)
 		xf86Msg(X_INFO, "mtev: position_y: %d %d\n",
 			caps->abs_position_y.minimum,
 			caps->abs_position_y.maximum);
+	if (caps->has_pressure)
+		xf86Msg(X_INFO, "mtev: pressure: %d %d\n",
+			caps->abs_pressure.minimum,
+			caps->abs_pressure.maximum);
 }
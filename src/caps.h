@@ -32,6 +32,7 @@ struct mtev_caps {
 	bool has_touch_major, has_touch_minor;
 	bool has_width_major, has_width_minor;
 	bool has_orientation, has_tracking_id;
+	bool has_pressure;
 	bool has_position_x, has_position_y;
 	struct input_absinfo abs_touch_major;
 	struct input_absinfo abs_touch_minor;
@@ -41,9 +42,19 @@ struct mtev_caps {
 	struct input_absinfo abs_position_x;
 	struct input_absinfo abs_position_y;
 	struct input_absinfo abs_tracking_id;
+	struct input_absinfo abs_pressure;
+};
+
+/* Identifies a physical device so probed caps can be reused */
+struct mtev_caps_key {
+	struct input_id id;
+	char uniq[64];
 };
 
 int caps_read(struct mtev_caps *caps, int fd);
+int caps_read_key(struct mtev_caps_key *key, int fd);
+bool caps_key_equal(const struct mtev_caps_key *a,
+		    const struct mtev_caps_key *b);
 void caps_output(const struct mtev_caps *caps);
 
 #endif
@@ -0,0 +1,231 @@
+/***************************************************************************
+ *
+ * Multitouch protocol X driver
+ * Copyright (C) 2008 Henrik Rydberg <rydberg@euromail.se>
+ * Copyright (C) 2009,2010 Nokia Corporation
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ **************************************************************************/
+
+#include <string.h>
+
+#include "debounce.h"
+
+/* Frame interval assumed until two frames have been seen */
+#define DEFAULT_FRAME_MS 10
+
+void debounce_init(struct mtev_debounce *db)
+{
+	memset(db, 0, sizeof(struct mtev_debounce));
+	db->frame_ms = DEFAULT_FRAME_MS;
+}
+
+/* Forget tracked contacts, limits and counters are kept */
+void debounce_reset(struct mtev_debounce *db)
+{
+	memset(db->slot, 0, sizeof(db->slot));
+}
+
+static long long diff_ms(const struct timeval *a, const struct timeval *b)
+{
+	return (a->tv_sec - b->tv_sec) * 1000LL +
+		(a->tv_usec - b->tv_usec) / 1000;
+}
+
+static bool old_enough(const struct mtev_debounce *db,
+		       const struct mtev_debounce_slot *s)
+{
+	if (db->use_ms)
+		return diff_ms(&s->last, &s->first) >= db->lifetime;
+
+	return s->frames >= db->lifetime;
+}
+
+static bool in_grace(const struct mtev_debounce *db,
+		     const struct mtev_debounce_slot *s,
+		     const struct timeval *now)
+{
+	if (db->use_ms)
+		return diff_ms(now, &s->last) <= db->grace;
+
+	return s->missing <= db->grace;
+}
+
+static void release(struct mtev_debounce *db, struct mtev_debounce_slot *s)
+{
+	if (!s->posted)
+		db->suppressed_contacts++;
+	s->used = 0;
+}
+
+/* Slot of a tracking id, a new one replaces a contact not in this frame */
+static struct mtev_debounce_slot *get_slot(struct mtev_debounce *db,
+					   int tracking_id)
+{
+	struct mtev_debounce_slot *free_slot = NULL;
+	struct mtev_debounce_slot *stale = NULL;
+	int i;
+
+	for (i = 0; i < HW_MAX_CONTACTS; i++) {
+		struct mtev_debounce_slot *s = &db->slot[i];
+
+		if (!s->used) {
+			if (!free_slot)
+				free_slot = s;
+		} else if (s->tp.tracking_id == tracking_id) {
+			return s;
+		} else if (!s->seen && !stale) {
+			stale = s;
+		}
+	}
+
+	if (!free_slot) {
+		free_slot = stale;
+		release(db, free_slot);
+	}
+
+	memset(free_slot, 0, sizeof(struct mtev_debounce_slot));
+	free_slot->used = 1;
+	return free_slot;
+}
+
+void debounce_filter(struct mtev_debounce *db, struct mtev_hw_state *hw)
+{
+	struct mtev_touch_point contact[HW_MAX_CONTACTS];
+	const struct timeval *now = &hw->time;
+	bool bridged = 0;
+	int num = 0;
+	int i;
+
+	if (!db->track_ids || (!db->lifetime && !db->grace)) {
+		debounce_reset(db);
+		return;
+	}
+
+	if (db->prev.tv_sec || db->prev.tv_usec) {
+		const long long interval = diff_ms(now, &db->prev);
+
+		if (interval > 0 && interval < 1000)
+			db->frame_ms = interval;
+	}
+	db->prev = *now;
+
+	for (i = 0; i < HW_MAX_CONTACTS; i++)
+		db->slot[i].seen = 0;
+
+	for (i = 0; i < hw->num_contacts; i++) {
+		struct mtev_debounce_slot *s;
+
+		s = get_slot(db, hw->contact[i].tracking_id);
+		if (!s->frames)
+			s->first = *now;
+		s->tp = hw->contact[i];
+		s->last = *now;
+		s->frames++;
+		s->missing = 0;
+		s->seen = 1;
+
+		if (!s->posted)
+			s->posted = old_enough(db, s);
+		if (s->posted)
+			contact[num++] = s->tp;
+	}
+
+	for (i = 0; i < HW_MAX_CONTACTS; i++) {
+		struct mtev_debounce_slot *s = &db->slot[i];
+
+		if (!s->used || s->seen)
+			continue;
+
+		// Repeated ids share a slot, leaving others to bridge
+		s->missing++;
+		if (s->posted && in_grace(db, s, now) &&
+		    num < HW_MAX_CONTACTS) {
+			contact[num++] = s->tp;
+			bridged = 1;
+		} else {
+			release(db, s);
+		}
+	}
+
+	if (bridged)
+		db->bridged_frames++;
+
+	memcpy(hw->contact, contact, num * sizeof(struct mtev_touch_point));
+	hw->num_contacts = num;
+}
+
+static bool is_bridged(const struct mtev_debounce_slot *s)
+{
+	return s->used && !s->seen && s->posted;
+}
+
+/*
+ * Milliseconds until the bridged contacts run out, 0 when there are
+ * none. Used to end them when the device stops sending frames.
+ */
+int debounce_timeout(const struct mtev_debounce *db)
+{
+	int i;
+
+	for (i = 0; i < HW_MAX_CONTACTS; i++) {
+		if (!is_bridged(&db->slot[i]))
+			continue;
+
+		if (db->use_ms)
+			return db->grace + 1;
+
+		return (db->grace + 1) * db->frame_ms;
+	}
+
+	return 0;
+}
+
+/* Drops the bridged contacts from the last frame, 1 if there were any */
+bool debounce_expire(struct mtev_debounce *db, struct mtev_hw_state *hw)
+{
+	bool expired = 0;
+	int kept = 0;
+	int i;
+	int j;
+
+	for (i = 0; i < hw->num_contacts; i++) {
+		bool bridged = 0;
+
+		for (j = 0; j < HW_MAX_CONTACTS; j++) {
+			struct mtev_debounce_slot *s = &db->slot[j];
+
+			if (is_bridged(s) &&
+			    s->tp.tracking_id == hw->contact[i].tracking_id) {
+				release(db, s);
+				bridged = 1;
+				break;
+			}
+		}
+
+		if (bridged) {
+			expired = 1;
+			continue;
+		}
+
+		if (kept != i)
+			hw->contact[kept] = hw->contact[i];
+		kept++;
+	}
+
+	hw->num_contacts = kept;
+	return expired;
+}
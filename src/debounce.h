@@ -0,0 +1,71 @@
+/***************************************************************************
+ *
+ * Multitouch protocol X driver
+ * Copyright (C) 2008 Henrik Rydberg <rydberg@euromail.se>
+ * Copyright (C) 2009,2010 Nokia Corporation
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ **************************************************************************/
+
+#ifndef DEBOUNCE_H
+#define DEBOUNCE_H
+
+#include "hw.h"
+
+/*
+ * Touch lifecycle filter. A new tracking id is held back until it has
+ * lived for the minimum lifetime, so ghosts are never posted. A posted
+ * contact that drops out is repeated at its last position for the
+ * release grace period, so a brief dropout does not end the touch.
+ * Both are in frames, or in kernel time milliseconds when use_ms is set.
+ * Contacts are told apart by tracking id only, so without track_ids the
+ * filter stays off.
+ */
+struct mtev_debounce_slot {
+	struct mtev_touch_point tp;
+	struct timeval first;
+	struct timeval last;
+	int frames;
+	int missing;
+	bool used;
+	bool seen;
+	bool posted;
+};
+
+struct mtev_debounce {
+	/* 0 disables the check */
+	int lifetime;
+	int grace;
+	bool use_ms;
+	bool track_ids;
+
+	struct mtev_debounce_slot slot[HW_MAX_CONTACTS];
+
+	/* Last frame time and interval, to time out bridged contacts */
+	struct timeval prev;
+	int frame_ms;
+
+	unsigned long suppressed_contacts;
+	unsigned long bridged_frames;
+};
+
+void debounce_init(struct mtev_debounce *db);
+void debounce_reset(struct mtev_debounce *db);
+void debounce_filter(struct mtev_debounce *db, struct mtev_hw_state *hw);
+int debounce_timeout(const struct mtev_debounce *db);
+bool debounce_expire(struct mtev_debounce *db, struct mtev_hw_state *hw);
+
+#endif
@@ -0,0 +1,142 @@
+/***************************************************************************
+ *
+ * Multitouch protocol X driver
+ * Copyright (C) 2008 Henrik Rydberg <rydberg@euromail.se>
+ * Copyright (C) 2009,2010 Nokia Corporation
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ **************************************************************************/
+
+#include <math.h>
+#include <string.h>
+
+#include "gesture.h"
+
+void gesture_init(struct mtev_gesture *g, int scroll_distance)
+{
+	memset(g, 0, sizeof(struct mtev_gesture));
+	g->scroll_distance = scroll_distance > 0 ? scroll_distance : 1;
+}
+
+void gesture_reset(struct mtev_gesture *g)
+{
+	gesture_init(g, g->scroll_distance);
+}
+
+static int take_clicks(int *acc, int distance)
+{
+	const int clicks = *acc / distance;
+	*acc -= clicks * distance;
+	return clicks;
+}
+
+static long long dist2(int x0, int y0, int x1, int y1)
+{
+	return (long long)(x1 - x0) * (x1 - x0) +
+		(long long)(y1 - y0) * (y1 - y0);
+}
+
+/*
+ * Contact order is not stable in protocol A, so the two fingers are
+ * ordered by tracking id. Without distinct ids the order closest to
+ * the previous frame is taken.
+ */
+static bool pair_swapped(const struct mtev_gesture *g,
+			 const int *x, const int *y, const int *id)
+{
+	if (id[0] != id[1])
+		return id[0] > id[1];
+
+	if (g->num_fingers != 2)
+		return 0;
+
+	return dist2(x[1], y[1], g->x[0], g->y[0]) +
+		dist2(x[0], y[0], g->x[1], g->y[1]) <
+		dist2(x[0], y[0], g->x[0], g->y[0]) +
+		dist2(x[1], y[1], g->x[1], g->y[1]);
+}
+
+/*
+ * Two fingers drive pan, pinch and rotate. Any other finger count, or
+ * another pair of tracking ids, ends the gesture and the next two
+ * finger frame starts a new one.
+ */
+void gesture_update(struct mtev_gesture *g, const int *x, const int *y,
+		    const int *id, int num_fingers)
+{
+	int a;
+	int b;
+	int center_x;
+	int center_y;
+	double distance;
+	double angle;
+	double turn;
+
+	g->pan_x = g->pan_y = 0;
+	g->scale = 0;
+	g->rotation = 0;
+	g->clicks_x = g->clicks_y = 0;
+
+	if (num_fingers != 2) {
+		if (g->num_fingers)
+			gesture_reset(g);
+		return;
+	}
+
+	a = pair_swapped(g, x, y, id);
+	b = !a;
+
+	if (g->num_fingers == 2 && (id[a] != g->id[0] || id[b] != g->id[1]))
+		gesture_reset(g);
+
+	center_x = ((long long)x[a] + x[b]) / 2;
+	center_y = ((long long)y[a] + y[b]) / 2;
+	distance = hypot((double)x[b] - x[a], (double)y[b] - y[a]);
+	angle = atan2((double)y[b] - y[a], (double)x[b] - x[a]);
+
+	if (g->num_fingers == 2) {
+		g->pan_x = center_x - g->center_x;
+		g->pan_y = center_y - g->center_y;
+
+		if (g->distance > 0)
+			g->scale = (distance / g->distance - 1.0) *
+				GESTURE_SCALE_ONE;
+
+		turn = angle - g->angle;
+		if (turn > M_PI)
+			turn -= 2 * M_PI;
+		else if (turn < -M_PI)
+			turn += 2 * M_PI;
+		g->rotation = turn * GESTURE_ROTATION_HALF / M_PI;
+
+		g->scroll_x += g->pan_x;
+		g->scroll_y += g->pan_y;
+		g->clicks_x = take_clicks(&g->scroll_x, g->scroll_distance);
+		g->clicks_y = take_clicks(&g->scroll_y, g->scroll_distance);
+	}
+
+	g->num_fingers = num_fingers;
+	g->id[0] = id[a];
+	g->id[1] = id[b];
+	g->x[0] = x[a];
+	g->y[0] = y[a];
+	g->x[1] = x[b];
+	g->y[1] = y[b];
+	g->center_x = center_x;
+	g->center_y = center_y;
+	g->distance = distance;
+	g->angle = angle;
+}
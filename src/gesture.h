@@ -0,0 +1,65 @@
+/***************************************************************************
+ *
+ * Multitouch protocol X driver
+ * Copyright (C) 2008 Henrik Rydberg <rydberg@euromail.se>
+ * Copyright (C) 2009,2010 Nokia Corporation
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ **************************************************************************/
+
+#ifndef GESTURE_H
+#define GESTURE_H
+
+#include "common.h"
+
+/* Button numbers used for two finger scrolling */
+#define GESTURE_BUTTON_UP     4
+#define GESTURE_BUTTON_DOWN   5
+#define GESTURE_BUTTON_LEFT   6
+#define GESTURE_BUTTON_RIGHT  7
+
+/* Scale is 16.16 fixed point, rotation in 1/64 degrees like X arcs */
+#define GESTURE_SCALE_ONE     65536
+#define GESTURE_ROTATION_HALF (180 * 64)
+
+struct mtev_gesture {
+	int scroll_distance;
+
+	/* Previous frame, fingers ordered as in pair_swapped() */
+	int num_fingers;
+	int id[2];
+	int x[2], y[2];
+	int center_x, center_y;
+	double distance;
+	double angle;
+
+	int scroll_x, scroll_y;
+
+	/* Deltas of the latest frame */
+	int pan_x, pan_y;
+	int scale;
+	int rotation;
+
+	/* Scroll clicks due from the latest frame, negative is up/left */
+	int clicks_x, clicks_y;
+};
+
+void gesture_init(struct mtev_gesture *g, int scroll_distance);
+void gesture_reset(struct mtev_gesture *g);
+void gesture_update(struct mtev_gesture *g, const int *x, const int *y,
+		    const int *id, int num_fingers);
+
+#endif
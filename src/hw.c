@@ -24,33 +24,75 @@
 #include <linux/input.h>
 
 #include "hw.h"
+#include "probes.h"
 
 void hw_init(struct mtev_hw_state *hw)
 {
 	memset(hw, 0, sizeof(struct mtev_hw_state));
 }
 
+#ifndef SYN_DROPPED
+#define SYN_DROPPED 3
+#endif
+
+#define ABS_MT_FIRST ABS_MT_TOUCH_MAJOR
+#define ABS_MT_LAST  ABS_MT_PRESSURE
+
+/*
+ * Contacts may leave out ABS_MT_TOOL_TYPE, which then means a finger.
+ * Contact 0 still holds the last frame until the next one starts.
+ */
+static void start_frame(struct mtev_hw_state *hw)
+{
+	if (hw->reading)
+		return;
+
+	hw->reading = 1;
+	hw->contact[0].tool_type = MT_TOOL_FINGER;
+}
+
 bool hw_read(struct mtev_hw_state *hw, const struct input_event* ev)
 {
 	// xf86Msg(X_INFO, "event: %d %d %d\n", ev->type, ev->code, ev->value);
 
+	// The rest of an overrun frame, the next one is whole again
+	if (hw->dropped) {
+		if (ev->type == EV_SYN && ev->code == SYN_REPORT)
+			hw->dropped = 0;
+		return 0;
+	}
+
 	switch (ev->type) {
 	case EV_SYN:
 		switch (ev->code) {
 		case SYN_REPORT:
 			hw->num_contacts = hw->num_read;
 			hw->num_read = 0;
+			hw->reading = 0;
+			hw->time = ev->time;
+			PROBE3(frame, hw->num_contacts,
+			       hw->time.tv_sec, hw->time.tv_usec);
 			return 1;
+		case SYN_DROPPED:
+			hw->num_read = 0;
+			hw->reading = 0;
+			hw->dropped = 1;
+			break;
 		case SYN_MT_REPORT:
-			if (hw->num_read < HW_MAX_CONTACTS) {
+			start_frame(hw);
+			if (hw->num_read < HW_MAX_CONTACTS)
 				hw->num_read++;
-			}
+			if (hw->num_read < HW_MAX_CONTACTS)
+				hw->contact[hw->num_read].tool_type =
+					MT_TOOL_FINGER;
 			break;
 		}
 		break;
 	case EV_ABS:
 		if (hw->num_read == HW_MAX_CONTACTS)
 			break;
+		if (ev->code >= ABS_MT_FIRST && ev->code <= ABS_MT_LAST)
+			start_frame(hw);
 		switch (ev->code) {
 		case ABS_MT_POSITION_X:
 			hw->contact[hw->num_read].position_x = ev->value;
@@ -79,6 +121,9 @@ bool hw_read(struct mtev_hw_state *hw, const struct input_event* ev)
 		case ABS_MT_TRACKING_ID:
 			hw->contact[hw->num_read].tracking_id = ev->value;
 			break;
+		case ABS_MT_TOOL_TYPE:
+			hw->contact[hw->num_read].tool_type = ev->value;
+			break;
 		}
 	}
 
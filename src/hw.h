@@ -23,6 +23,7 @@
 #ifndef HWDATA_H
 #define HWDATA_H
 
+#include <sys/time.h>
 #include "common.h"
 
 struct input_event;
@@ -37,12 +38,16 @@ struct mtev_touch_point {
 	int position_x, position_y;
 	int pressure;
 	int tracking_id;
+	int tool_type;
 };
 
 struct mtev_hw_state {
 	struct mtev_touch_point contact[HW_MAX_CONTACTS];
 	int num_contacts;
 	int num_read;
+	bool reading;		/* Events of the next frame have arrived */
+	bool dropped;		/* Skipping events up to the next SYN_REPORT */
+	struct timeval time;	/* Kernel time of the SYN_REPORT */
 };
 
 void hw_init(struct mtev_hw_state *hw);
@@ -22,90 +22,508 @@
 
 #include <string.h>
 #include <errno.h>
+#include <time.h>
 #include <unistd.h>
+#include <sys/ioctl.h>
 #include <xf86.h>
 
 #include "mtouch.h"
+#include "probes.h"
 
-int mtouch_configure(struct mtev_mtouch *mt, int fd)
+static void evbuf_init(struct mtev_evbuf *buf)
 {
-	int rc = caps_read(&mt->caps, fd);
+	buf->head = 0;
+	buf->tail = 0;
+}
+
+static const struct input_event* read_event(struct mtev_evbuf *buf, int fd)
+{
+	char *data = (char *)buf->ev;
+	struct input_event *ev;
+
+	if (buf->tail - buf->head < sizeof(struct input_event)) {
+		const unsigned long partial = buf->tail - buf->head;
+		int n;
+
+		// Keep the incomplete event, the rest of it comes next
+		if (partial)
+			memmove(data, data + buf->head, partial);
+		buf->head = 0;
+		buf->tail = partial;
+
+		SYSCALL(n = read(fd, data + partial,
+				 sizeof(buf->ev) - partial));
+		if (n <= 0)
+			return NULL;
+
+		buf->tail += n;
+		PROBE2(read, n, buf->tail / sizeof(struct input_event));
+
+		if (buf->tail < sizeof(struct input_event))
+			return NULL;
+	}
+
+	ev = (struct input_event *)(data + buf->head);
+	buf->head += sizeof(struct input_event);
+	return ev;
+}
+
+static int configure_node(struct mtev_node *node, bool locked)
+{
+	struct mtev_caps_key key;
+	int rc;
+
+	rc = caps_read_key(&key, node->fd);
 	if (rc < 0)
 		return rc;
-	caps_output(&mt->caps);
+
+	// Same device as last time, skip the full probe
+	if (node->caps_valid && caps_key_equal(&key, &node->caps_key))
+		return 0;
+
+	// Another device, but the axes still have the ranges of the old one
+	if (node->caps_valid && locked)
+		return -ENODEV;
+
+	rc = caps_read(&node->caps, node->fd);
+	if (rc < 0) {
+		node->caps_valid = 0;
+		return rc;
+	}
+
+	node->caps_key = key;
+	node->caps_valid = 1;
+	caps_output(&node->caps);
 	return 0;
 }
 
-int mtouch_open(struct mtev_mtouch *mt, int fd)
+static void configure_tiles(struct mtev_mtouch *mt)
 {
-	memset(&mt->ev, 0, sizeof(mt->ev));
-	mt->num_events = 0;
-	mt->num_events_read = 0;
-	hw_init(&mt->hw_state);
+	int width = 0;
+	int height = 0;
+	int i;
+
+	for (i = 0; i < mt->num_nodes; i++) {
+		struct mtev_node *node = &mt->node[i];
+
+		// Untiled nodes are placed left to right in device units
+		if (!node->has_tile) {
+			node->tile_x = width;
+			node->tile_y = 0;
+			node->tile_width = node->caps.abs_position_x.maximum -
+				node->caps.abs_position_x.minimum + 1;
+			node->tile_height = node->caps.abs_position_y.maximum -
+				node->caps.abs_position_y.minimum + 1;
+		}
+
+		if (node->tile_x + node->tile_width > width)
+			width = node->tile_x + node->tile_width;
+		if (node->tile_y + node->tile_height > height)
+			height = node->tile_y + node->tile_height;
+
+		xf86Msg(X_INFO, "mtev: node %d tile %d %d %d %d\n", i,
+			node->tile_x, node->tile_y,
+			node->tile_width, node->tile_height);
+	}
+
+	mt->caps.abs_position_x.minimum = 0;
+	mt->caps.abs_position_x.maximum = width - 1;
+	mt->caps.abs_position_y.minimum = 0;
+	mt->caps.abs_position_y.maximum = height - 1;
+	mt->caps.abs_tracking_id.minimum = 0;
+	mt->caps.abs_tracking_id.maximum = HW_MAX_CONTACTS - 1;
+}
+
+static int percent_of(const struct input_absinfo *abs, int percent)
+{
+	if (!percent)
+		return 0;
+
+	return abs->minimum +
+		(long long)(abs->maximum - abs->minimum) * percent / 100;
+}
+
+/* Output ranges and limits depend on caps and config */
+static void update_ranges(struct mtev_mtouch *mt)
+{
+	const struct input_absinfo *abs_x = &mt->caps.abs_position_x;
+	const struct input_absinfo *abs_y = &mt->caps.abs_position_y;
+
+	if (mt->cfg.swap_xy) {
+		abs_x = &mt->caps.abs_position_y;
+		abs_y = &mt->caps.abs_position_x;
+	}
+
+	mt->min_x = abs_x->minimum;
+	mt->max_x = abs_x->maximum;
+	mt->min_y = abs_y->minimum;
+	mt->max_y = abs_y->maximum;
+
+	mt->map_output = mt->cfg.output_x || mt->cfg.output_y ||
+		mt->cfg.output_width != MT_OUTPUT_FULL ||
+		mt->cfg.output_height != MT_OUTPUT_FULL;
+	mt->map_offset_x = (long long)(mt->max_x - mt->min_x) *
+		mt->cfg.output_x >> 16;
+	mt->map_offset_y = (long long)(mt->max_y - mt->min_y) *
+		mt->cfg.output_y >> 16;
+	mt->map_scale_x = mt->cfg.output_width;
+	mt->map_scale_y = mt->cfg.output_height;
+
+	mt->palm.max_touch_major = mt->caps.has_touch_major ?
+		percent_of(&mt->caps.abs_touch_major,
+			   mt->cfg.palm_touch_major) : 0;
+	mt->palm.max_width_major = mt->caps.has_width_major ?
+		percent_of(&mt->caps.abs_width_major,
+			   mt->cfg.palm_width_major) : 0;
+	mt->palm.track_ids = mt->caps.has_tracking_id;
+
+	mt->debounce.lifetime = mt->cfg.touch_lifetime;
+	mt->debounce.grace = mt->cfg.touch_grace;
+	mt->debounce.use_ms = mt->cfg.touch_time_ms;
+	mt->debounce.track_ids = mt->caps.has_tracking_id;
+}
+
+int mtouch_configure(struct mtev_mtouch *mt)
+{
+	int rc;
+	int i;
+
+	for (i = 0; i < mt->num_nodes; i++) {
+		rc = configure_node(&mt->node[i], mt->caps_locked);
+		if (rc < 0)
+			return rc;
+	}
+
+	mt->caps = mt->node[0].caps;
+	if (mt->num_nodes > 1)
+		configure_tiles(mt);
+
+	update_ranges(mt);
 	return 0;
 }
 
-int mtouch_close(struct mtev_mtouch *mt, int fd)
+/* Caller must keep read_input() out, i.e. block SIGIO */
+void mtouch_set_config(struct mtev_mtouch *mt, const struct mtev_config *cfg)
+{
+	mt->cfg_shadow = *cfg;
+	mt->cfg_pending = 1;
+}
+
+/* Called from the input path between frames */
+static void commit_config(struct mtev_mtouch *mt)
+{
+	mt->cfg = mt->cfg_shadow;
+	mt->cfg_pending = 0;
+
+	mt->gesture.scroll_distance = mt->cfg.scroll_distance;
+	update_ranges(mt);
+}
+
+static void reset_state(struct mtev_mtouch *mt)
 {
-	memset(&mt->ev, 0, sizeof(mt->ev));
-	mt->num_events = 0;
-	mt->num_events_read = 0;
+	int i;
+
+	for (i = 0; i < mt->num_nodes; i++) {
+		evbuf_init(&mt->node[i].evbuf);
+		hw_init(&mt->node[i].hw_state);
+		hw_init(&mt->node[i].frame);
+	}
 	hw_init(&mt->hw_state);
+	memset(mt->id_map, 0, sizeof(mt->id_map));
+	gesture_reset(&mt->gesture);
+	velocity_init(&mt->velocity);
+	palm_reset(&mt->palm);
+	debounce_reset(&mt->debounce);
+}
+
+/* Ask for CLOCK_MONOTONIC event times, the clock the server uses */
+static bool set_monotonic_time(int fd)
+{
+#ifdef EVIOCSCLOCKID
+	int clock = CLOCK_MONOTONIC;
+	int rc;
+
+	SYSCALL(rc = ioctl(fd, EVIOCSCLOCKID, &clock));
+	return rc >= 0;
+#else
 	return 0;
+#endif
 }
 
-const struct input_event* mtouch_read_event(struct mtev_mtouch *mt, int fd)
+/*
+ * With the grab held no other evdev client, including another X
+ * driver instance, gets events from the node.
+ */
+static int grab_node(struct mtev_node *node, int n)
 {
-	struct input_event *ev;
+	int rc;
 
-	if (mt->num_events_read >= mt->num_events) {
-		int n;
+	SYSCALL(rc = ioctl(node->fd, EVIOCGRAB, (void *)1));
+	node->grabbed = rc >= 0;
+	if (node->grabbed)
+		return 0;
 
-		SYSCALL(n = read(fd, mt->ev, MAX_EVENTS * sizeof(struct input_event)));
-		if (n <= 0)
-			return NULL;
+	// The holder of the grab gets every event, we would get none
+	if (errno == EBUSY) {
+		xf86Msg(X_ERROR, "mtev: node %d is grabbed by another "
+			"client, no events would reach this device\n", n);
+		return -EBUSY;
+	}
 
-		if (n % sizeof(struct input_event)) {
-			xf86Msg(X_ERROR, "returned non aligned input event!\n");
-			return NULL;
+	xf86Msg(X_WARNING, "mtev: cannot grab node %d: %s\n",
+		n, strerror(errno));
+	return 0;
+}
+
+static void ungrab_node(struct mtev_node *node, int n)
+{
+	int rc;
+
+	if (!node->grabbed)
+		return;
+
+	SYSCALL(rc = ioctl(node->fd, EVIOCGRAB, (void *)0));
+	if (rc < 0)
+		xf86Msg(X_WARNING, "mtev: cannot ungrab node %d: %s\n",
+			n, strerror(errno));
+	node->grabbed = 0;
+}
+
+/*
+ * The node stays open from DEVICE_INIT on, so whatever was queued
+ * before DEVICE_ON is stale. Read it all, and if that stopped inside a
+ * frame leave the rest of it to hw_read() to drop.
+ */
+static void drain_node(struct mtev_node *node)
+{
+	const struct input_event *ev;
+	bool partial = 0;
+
+	while ((ev = read_event(&node->evbuf, node->fd)))
+		partial = ev->type != EV_SYN || ev->code != SYN_REPORT;
+
+	node->hw_state.dropped = partial;
+}
+
+int mtouch_open(struct mtev_mtouch *mt)
+{
+	int rc;
+	int i;
+
+	reset_state(mt);
+
+	mt->monotonic_time = 1;
+	for (i = 0; i < mt->num_nodes; i++) {
+		drain_node(&mt->node[i]);
+		if (!set_monotonic_time(mt->node[i].fd))
+			mt->monotonic_time = 0;
+		if (!mt->grab)
+			continue;
+
+		rc = grab_node(&mt->node[i], i);
+		if (rc < 0) {
+			while (i--)
+				ungrab_node(&mt->node[i], i);
+			return rc;
 		}
+	}
+
+	return 0;
+}
+
+int mtouch_close(struct mtev_mtouch *mt)
+{
+	int i;
+
+	for (i = 0; i < mt->num_nodes; i++)
+		ungrab_node(&mt->node[i], i);
+
+	reset_state(mt);
+	return 0;
+}
 
-		mt->num_events = n / sizeof(struct input_event);
-		mt->num_events_read = 0;
+static int merge_id(struct mtev_mtouch *mt, int node, int tracking_id)
+{
+	int free_id = -1;
+	int i;
+
+	for (i = 0; i < HW_MAX_CONTACTS; i++) {
+		struct mtev_id_map *map = &mt->id_map[i];
+
+		if (!map->used) {
+			if (free_id < 0)
+				free_id = i;
+			continue;
+		}
+		if (map->node == node && map->tracking_id == tracking_id) {
+			map->seen = 1;
+			return i;
+		}
 	}
 
-	if (mt->num_events > mt->num_events_read) {
-		ev = &mt->ev[mt->num_events_read];
-		mt->num_events_read++;
-		return ev;
+	if (free_id >= 0) {
+		mt->id_map[free_id].node = node;
+		mt->id_map[free_id].tracking_id = tracking_id;
+		mt->id_map[free_id].used = 1;
+		mt->id_map[free_id].seen = 1;
 	}
 
-	// This should not happen
-	xf86Msg(X_ERROR, "mtev: got read_event without event!\n");
-	return NULL;
+	return free_id;
+}
+
+static int map_tile(int value, const struct input_absinfo *abs,
+		    int offset, int size)
+{
+	const int range = abs->maximum - abs->minimum + 1;
+
+	if (range <= 1)
+		return offset;
+	return offset + (long long)(value - abs->minimum) * size / range;
+}
+
+/*
+ * Build one frame out of the latest completed frame of every node. The
+ * other nodes may be in the middle of their next one, so this reads the
+ * copies taken at their SYN_REPORT. Contacts of nodes without tracking
+ * ids are told apart by their place in the frame.
+ */
+static void merge_nodes(struct mtev_mtouch *mt)
+{
+	struct mtev_hw_state *hw = &mt->hw_state;
+	int i;
+	int j;
+
+	for (i = 0; i < HW_MAX_CONTACTS; i++)
+		mt->id_map[i].seen = 0;
+
+	hw->num_contacts = 0;
+	for (i = 0; i < mt->num_nodes; i++) {
+		const struct mtev_node *node = &mt->node[i];
+
+		for (j = 0; j < node->frame.num_contacts; j++) {
+			const struct mtev_touch_point *src =
+				&node->frame.contact[j];
+			struct mtev_touch_point *dst;
+			int id;
+
+			if (hw->num_contacts == HW_MAX_CONTACTS)
+				break;
+
+			id = merge_id(mt, i, node->caps.has_tracking_id ?
+				      src->tracking_id : j);
+			if (id < 0)
+				break;
+
+			dst = &hw->contact[hw->num_contacts++];
+			*dst = *src;
+			dst->tracking_id = id;
+			dst->position_x = map_tile(src->position_x,
+						   &node->caps.abs_position_x,
+						   node->tile_x,
+						   node->tile_width);
+			dst->position_y = map_tile(src->position_y,
+						   &node->caps.abs_position_y,
+						   node->tile_y,
+						   node->tile_height);
+		}
+	}
+
+	for (i = 0; i < HW_MAX_CONTACTS; i++)
+		if (!mt->id_map[i].seen)
+			mt->id_map[i].used = 0;
+}
+
+static const struct mtev_hw_state* frame_state(const struct mtev_mtouch *mt)
+{
+	if (mt->num_nodes > 1)
+		return &mt->hw_state;
+
+	return &mt->node[0].hw_state;
+}
+
+/* Runs on every completed frame before it is handed out */
+static void filter_frame(struct mtev_mtouch *mt)
+{
+	struct mtev_hw_state *hw = (struct mtev_hw_state *)frame_state(mt);
+
+	if (mt->cfg_pending)
+		commit_config(mt);
+
+	palm_filter(&mt->palm, hw);
+	debounce_filter(&mt->debounce, hw);
+}
+
+/* Called once a node has parsed a SYN_REPORT */
+void mtouch_complete_frame(struct mtev_mtouch *mt, struct mtev_node *node)
+{
+	if (mt->num_nodes > 1) {
+		node->frame = node->hw_state;
+		merge_nodes(mt);
+		mt->hw_state.time = node->hw_state.time;
+	}
+	filter_frame(mt);
 }
 
 bool mtouch_read_synchronized_event(struct mtev_mtouch *mt, int fd)
 {
 	const struct input_event* ev;
+	struct mtev_node *node = NULL;
+	int i;
+
+	for (i = 0; i < mt->num_nodes; i++) {
+		if (mt->node[i].fd == fd) {
+			node = &mt->node[i];
+			break;
+		}
+	}
+	if (!node)
+		return 0;
 
-	while ((ev = mtouch_read_event(mt, fd))) {
-		if (hw_read(&mt->hw_state, ev))
+	while ((ev = read_event(&node->evbuf, fd))) {
+		if (hw_read(&node->hw_state, ev)) {
+			mtouch_complete_frame(mt, node);
 			return 1;
+		}
 	}
 
 	return 0;
 }
 
+int mtouch_expire_timeout(const struct mtev_mtouch *mt)
+{
+	return debounce_timeout(&mt->debounce);
+}
+
+/* Ends bridged contacts between frames, caller must block SIGIO */
+bool mtouch_expire_contacts(struct mtev_mtouch *mt)
+{
+	int i;
+
+	/* A partly read frame shares the contact storage */
+	for (i = 0; i < mt->num_nodes; i++)
+		if (mt->node[i].hw_state.reading)
+			return 0;
+
+	return debounce_expire(&mt->debounce,
+			       (struct mtev_hw_state *)frame_state(mt));
+}
+
 int mtouch_num_contacts(const struct mtev_mtouch *mt)
 {
-	return mt->hw_state.num_contacts;
+	return frame_state(mt)->num_contacts;
+}
+
+const struct timeval* mtouch_frame_time(const struct mtev_mtouch *mt)
+{
+	return &frame_state(mt)->time;
 }
 
 const struct mtev_touch_point* mtouch_get_contact(const struct mtev_mtouch *mt, int n)
 {
-	if (n < mt->hw_state.num_contacts)
-		return mt->hw_state.contact + n;
+	const struct mtev_hw_state *hw = frame_state(mt);
+
+	if (n < hw->num_contacts)
+		return hw->contact + n;
 
 	return NULL;
 }
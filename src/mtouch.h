@@ -24,20 +24,45 @@
 #define MTOUCH_H
 
 #include "caps.h"
+#include "debounce.h"
+#include "gesture.h"
 #include "hw.h"
-
-#define MT_AXIS_PER_FINGER   5
+#include "palm.h"
+#include "velocity.h"
+
+/* Axes that can be exported per finger, see the "Axes" option */
+enum mtev_axis {
+	MT_AXIS_POSITION_X,
+	MT_AXIS_POSITION_Y,
+	MT_AXIS_TOUCH_MAJOR,
+	MT_AXIS_TOUCH_MINOR,
+	MT_AXIS_WIDTH_MAJOR,
+	MT_AXIS_WIDTH_MINOR,
+	MT_AXIS_ORIENTATION,
+	MT_AXIS_PRESSURE,
+	MT_AXIS_TRACKING_ID,
+	MT_AXIS_VELOCITY_X,
+	MT_AXIS_VELOCITY_Y,
+	MT_AXIS_ACCELERATION_X,
+	MT_AXIS_ACCELERATION_Y,
+	MT_AXIS_COUNT
+};
 
 /*
  * How many fingers we export to upwards
  * The MAX_VALUATORS limits these.
- * MT_NUM_VALUATORS needs to be less or equal than MAX_VALUATORS
+ * MT_NUM_FINGERS times the number of exported axes needs to be
+ * less or equal than MAX_VALUATORS
  */
 
 #define MT_NUM_FINGERS       6
-#define MT_NUM_VALUATORS     (MT_NUM_FINGERS * MT_AXIS_PER_FINGER)
 
-#define MT_NUM_BUTTONS       1
+/* Gesture valuators follow the per finger axes when enabled */
+#define MT_NUM_GESTURE_VALUATORS 4
+
+/* Most valuators a device can have, the server may allow fewer */
+#define MT_MAX_VALUATORS \
+	(1 + MT_NUM_GESTURE_VALUATORS + 1 + MT_NUM_FINGERS * MT_AXIS_COUNT)
 
 /* Axis labels */
 
@@ -52,34 +77,175 @@
 #define AXIS_LABEL_PROP_ABS_MT_BLOB_ID     "Abs MT Blob ID"
 #define AXIS_LABEL_PROP_ABS_MT_TRACKING_ID "Abs MT Tracking ID"
 #define AXIS_LABEL_PROP_ABS_MT_PRESSURE    "Abs MT Pressure"
+#define AXIS_LABEL_PROP_MT_VELOCITY_X      "MT Velocity X"
+#define AXIS_LABEL_PROP_MT_VELOCITY_Y      "MT Velocity Y"
+#define AXIS_LABEL_PROP_MT_ACCELERATION_X  "MT Acceleration X"
+#define AXIS_LABEL_PROP_MT_ACCELERATION_Y  "MT Acceleration Y"
+
+#define AXIS_LABEL_PROP_MT_GESTURE_PAN_X    "MT Gesture Pan X"
+#define AXIS_LABEL_PROP_MT_GESTURE_PAN_Y    "MT Gesture Pan Y"
+#define AXIS_LABEL_PROP_MT_GESTURE_SCALE    "MT Gesture Scale"
+#define AXIS_LABEL_PROP_MT_GESTURE_ROTATION "MT Gesture Rotation"
+#define AXIS_LABEL_PROP_MT_FRAME_TIME       "MT Frame Time"
+#define AXIS_LABEL_PROP_MT_CONTACT_COUNT    "MT Contact Count"
 
 #define MAX_EVENTS 256
 
-struct mtev_mtouch {
+/*
+ * Raw event buffer. Offsets are in bytes so that a read ending in
+ * the middle of an event is carried over to the next read.
+ */
+struct mtev_evbuf {
 	struct input_event ev[MAX_EVENTS];
-	unsigned long num_events;
-	unsigned long num_events_read;
+	unsigned long head;
+	unsigned long tail;
+};
+
+/*
+ * One evdev node. Several nodes can be tiled into one logical
+ * surface, each covering a rectangle of the shared coordinate space.
+ */
+struct mtev_node {
+	int fd;
+	const char *path;
+	void *handler;
+	bool grabbed;
 
+	struct mtev_evbuf evbuf;
 	struct mtev_hw_state hw_state;
+
+	/* Last completed frame, what merge_nodes() reads */
+	struct mtev_hw_state frame;
 	struct mtev_caps caps;
+	struct mtev_caps_key caps_key;
+	bool caps_valid;
 
+	bool has_tile;
+	int tile_x, tile_y;
+	int tile_width, tile_height;
+};
+
+#define MT_MAX_NODES 6
+
+/* Maps a node local tracking id into an id unique over all nodes */
+struct mtev_id_map {
+	int node;
+	int tracking_id;
+	bool used;
+	bool seen;
+};
+
+/* Parameters that can be changed at runtime through device properties */
+struct mtev_config {
+	bool swap_xy;
 	bool invert_x;
 	bool invert_y;
-	bool swap_xy;
+	int scroll_distance;
+
+	/* Palm limits in percent of the axis range, 0 disables */
+	int palm_touch_major;
+	int palm_width_major;
+
+	/* Minimum touch lifetime and release grace, 0 disables */
+	int touch_lifetime;
+	int touch_grace;
+	bool touch_time_ms;
+
+	/* Screen area the device maps to, 16.16 fractions of the screen */
+	int output_x, output_y;
+	int output_width, output_height;
+};
+
+#define MT_OUTPUT_FULL (1 << 16)
+
+struct mtev_mtouch {
+	struct mtev_node node[MT_MAX_NODES];
+	int num_nodes;
+
+	/* Merged frame when aggregating more than one node */
+	struct mtev_hw_state hw_state;
+	struct mtev_id_map id_map[HW_MAX_CONTACTS];
+
+	/* Caps of the logical surface */
+	struct mtev_caps caps;
+
+	/* Set while the valuators are set up from the caps */
+	bool caps_locked;
+
+	/* Exported per finger axes, in valuator order */
+	enum mtev_axis axis[MT_AXIS_COUNT];
+	int num_axes;
+
+	/* Fingers posted as valuators, see the "MaxContacts" option */
+	int num_fingers;
+
+	/* Last posted values, kept for fingers that are not down */
+	int valuators[MT_MAX_VALUATORS];
+	bool button_down;
+
+	/* Set when a velocity or acceleration axis is exported */
+	bool velocity_axes;
+	struct mtev_velocity velocity;
+
+	struct mtev_palm palm;
+
+	/* Touch lifecycle filter, the timer ends contacts when frames stop */
+	struct mtev_debounce debounce;
+	void *debounce_timer;
+	bool debounce_armed;
+
+	bool gestures;
+	struct mtev_gesture gesture;
+
+	bool timestamps;
+	bool monotonic_time;
+
+	/* Take exclusive access to the nodes while on */
+	bool grab;
+
+	/* Pen contacts go to a separate device, see pen.c */
+	bool pen_routing;
+	void *pen_local;
+	volatile bool pen_on;
+	bool pen_down;
+	bool pen_queued;
+
+	/* Active config, only replaced at frame boundaries */
+	struct mtev_config cfg;
+
+	/* Written with SIGIO blocked, picked up by the next frame */
+	struct mtev_config cfg_shadow;
+	volatile bool cfg_pending;
 
 	int min_x;
 	int max_x;
 
 	int min_y;
 	int max_y;
+
+	/* Output mapping derived from the config, see update_ranges() */
+	bool map_output;
+	int map_offset_x, map_offset_y;
+	int map_scale_x, map_scale_y;
+
+	/* MapToOutput, followed through RandR while the device is on */
+	char *output_name;
+	int output_screen;
+	bool output_active;
 };
 
-int mtouch_configure(struct mtev_mtouch *mt, int fd);
-int mtouch_open(struct mtev_mtouch *mt, int fd);
-int mtouch_close(struct mtev_mtouch *mt, int fd);
+int mtouch_configure(struct mtev_mtouch *mt);
+int mtouch_open(struct mtev_mtouch *mt);
+int mtouch_close(struct mtev_mtouch *mt);
+
+void mtouch_set_config(struct mtev_mtouch *mt, const struct mtev_config *cfg);
 
+void mtouch_complete_frame(struct mtev_mtouch *mt, struct mtev_node *node);
 bool mtouch_read_synchronized_event(struct mtev_mtouch *mt, int fd);
 int mtouch_num_contacts(const struct mtev_mtouch *mt);
+const struct timeval* mtouch_frame_time(const struct mtev_mtouch *mt);
+int mtouch_expire_timeout(const struct mtev_mtouch *mt);
+bool mtouch_expire_contacts(struct mtev_mtouch *mt);
 const struct mtev_touch_point* mtouch_get_contact(const struct mtev_mtouch *mt, int n);
 
 #endif
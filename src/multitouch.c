@@ -23,22 +23,66 @@
 #define MODULEVENDORSTRING "Nokia"
 
 #include "xorg-server.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <sys/time.h>
 #include <xorg/exevents.h>
 #include <xorg/xserver-properties.h>
 #include <X11/Xatom.h>
+#include <randrstr.h>
 #include <xf86.h>
 #include <xf86_OSproc.h>
 #include <xf86Xinput.h>
 
 #include "common.h"
 #include "mtouch.h"
+#include "pen.h"
+#include "post.h"
+#include "probes.h"
 
+/* Indexed by enum mtev_axis */
 static const char* const axis_labels_str[] = {
 	AXIS_LABEL_PROP_ABS_MT_POSITION_X,
 	AXIS_LABEL_PROP_ABS_MT_POSITION_Y,
 	AXIS_LABEL_PROP_ABS_MT_TOUCH_MAJOR,
 	AXIS_LABEL_PROP_ABS_MT_TOUCH_MINOR,
+	AXIS_LABEL_PROP_ABS_MT_WIDTH_MAJOR,
+	AXIS_LABEL_PROP_ABS_MT_WIDTH_MINOR,
+	AXIS_LABEL_PROP_ABS_MT_ORIENTATION,
+	AXIS_LABEL_PROP_ABS_MT_PRESSURE,
 	AXIS_LABEL_PROP_ABS_MT_TRACKING_ID,
+	AXIS_LABEL_PROP_MT_VELOCITY_X,
+	AXIS_LABEL_PROP_MT_VELOCITY_Y,
+	AXIS_LABEL_PROP_MT_ACCELERATION_X,
+	AXIS_LABEL_PROP_MT_ACCELERATION_Y,
+};
+
+/* Names for the "Axes" option, indexed by enum mtev_axis */
+static const char* const axis_names[] = {
+	"x",
+	"y",
+	"touch_major",
+	"touch_minor",
+	"width_major",
+	"width_minor",
+	"orientation",
+	"pressure",
+	"tracking_id",
+	"velocity_x",
+	"velocity_y",
+	"acceleration_x",
+	"acceleration_y",
+};
+
+#define DEFAULT_AXES "x y touch_major touch_minor tracking_id"
+
+static const char* const gesture_labels_str[] = {
+	AXIS_LABEL_PROP_MT_GESTURE_PAN_X,
+	AXIS_LABEL_PROP_MT_GESTURE_PAN_Y,
+	AXIS_LABEL_PROP_MT_GESTURE_SCALE,
+	AXIS_LABEL_PROP_MT_GESTURE_ROTATION,
 };
 
 static void pointer_control(DeviceIntPtr dev, PtrCtrl *ctrl)
@@ -46,42 +90,261 @@ static void pointer_control(DeviceIntPtr dev, PtrCtrl *ctrl)
 	xf86Msg(X_INFO, "pointer_control\n");
 }
 
+/* Writable properties, see init_config_properties() */
+static Atom prop_swap_axes;
+static Atom prop_invert_axes;
+static Atom prop_scroll_distance;
+static Atom prop_palm_size;
+static Atom prop_touch_debounce;
+
+/* Read only, refreshed when a client reads them */
+static Atom prop_palm_rejections;
+static Atom prop_debounce_counts;
+static bool updating_stats;
+
+static void warn_debounce(const struct mtev_mtouch *mt,
+			  const struct mtev_config *cfg)
+{
+	if ((cfg->touch_lifetime || cfg->touch_grace) &&
+	    !mt->caps.has_tracking_id)
+		xf86Msg(X_WARNING, "mtev: no tracking ids, touch lifetime "
+			"and release grace are off\n");
+}
+
 static int pointer_property(DeviceIntPtr dev,
 			    Atom property,
 			    XIPropertyValuePtr prop,
 			    BOOL checkonly)
 {
-	xf86Msg(X_INFO, "pointer_property\n");
+	LocalDevicePtr local = dev->public.devicePrivate;
+	struct mtev_mtouch *mt = local->private;
+	struct mtev_config cfg = mt->cfg_shadow;
+	int sigstate;
+
+	if (property == prop_swap_axes) {
+		if (prop->type != XA_INTEGER || prop->format != 8 ||
+		    prop->size != 1)
+			return BadMatch;
+		cfg.swap_xy = !!((CARD8 *)prop->data)[0];
+	} else if (property == prop_invert_axes) {
+		if (prop->type != XA_INTEGER || prop->format != 8 ||
+		    prop->size != 2)
+			return BadMatch;
+		cfg.invert_x = !!((CARD8 *)prop->data)[0];
+		cfg.invert_y = !!((CARD8 *)prop->data)[1];
+	} else if (property == prop_scroll_distance) {
+		if (prop->type != XA_INTEGER || prop->format != 32 ||
+		    prop->size != 1)
+			return BadMatch;
+		cfg.scroll_distance = ((CARD32 *)prop->data)[0];
+		if (cfg.scroll_distance < 1)
+			return BadValue;
+	} else if (property == prop_palm_size) {
+		if (prop->type != XA_INTEGER || prop->format != 8 ||
+		    prop->size != 2)
+			return BadMatch;
+		cfg.palm_touch_major = ((CARD8 *)prop->data)[0];
+		cfg.palm_width_major = ((CARD8 *)prop->data)[1];
+		if (cfg.palm_touch_major > 100 || cfg.palm_width_major > 100)
+			return BadValue;
+	} else if (property == prop_touch_debounce) {
+		if (prop->type != XA_INTEGER || prop->format != 32 ||
+		    prop->size != 3)
+			return BadMatch;
+		cfg.touch_lifetime = ((CARD32 *)prop->data)[0];
+		cfg.touch_grace = ((CARD32 *)prop->data)[1];
+		cfg.touch_time_ms = !!((CARD32 *)prop->data)[2];
+		if (cfg.touch_lifetime < 0 || cfg.touch_grace < 0)
+			return BadValue;
+	} else if (property == prop_palm_rejections ||
+		   property == prop_debounce_counts) {
+		return updating_stats ? Success : BadAccess;
+	} else {
+		return Success;
+	}
+
+	if (checkonly)
+		return Success;
+
+	if (property == prop_touch_debounce)
+		warn_debounce(mt, &cfg);
+
+	/* The input path swaps it in at the next frame */
+	sigstate = xf86BlockSIGIO();
+	mtouch_set_config(mt, &cfg);
+	xf86UnblockSIGIO(sigstate);
+
 	return Success;
 }
 
-static void init_axes_labels(Atom* labels, int num_labels)
+/* Scroll buttons 4-7 are only there for gestures */
+static int num_buttons(const struct mtev_mtouch *mt)
+{
+	return mt->gestures ? GESTURE_BUTTON_RIGHT : 1;
+}
+
+static int get_property(DeviceIntPtr dev, Atom property)
+{
+	LocalDevicePtr local = dev->public.devicePrivate;
+	struct mtev_mtouch *mt = local->private;
+	CARD32 values[2];
+	int num_values;
+	int rc;
+
+	if (property == prop_palm_rejections) {
+		values[0] = mt->palm.rejected_contacts;
+		values[1] = mt->palm.rejected_frames;
+		num_values = 2;
+	} else if (property == prop_debounce_counts) {
+		values[0] = mt->debounce.suppressed_contacts;
+		values[1] = mt->debounce.bridged_frames;
+		num_values = 2;
+	} else {
+		return Success;
+	}
+
+	updating_stats = 1;
+	rc = XIChangeDeviceProperty(dev, property, XA_INTEGER, 32,
+				    PropModeReplace, num_values, values, FALSE);
+	updating_stats = 0;
+
+	return rc;
+}
+
+static void init_axes_labels(Atom* labels, const struct mtev_mtouch *mt)
 {
+	const int first = post_gesture_valuator(mt);
+	const char *label;
 	int i;
 
-	for (i = 0 ; i < num_labels; i++) {
-		labels[i] = MakeAtom(axis_labels_str[i % MT_AXIS_PER_FINGER],
-				     strlen(axis_labels_str[i % MT_AXIS_PER_FINGER]),
-				     TRUE);
+	if (post_num_frame_valuators(mt)) {
+		label = AXIS_LABEL_PROP_MT_CONTACT_COUNT;
+		labels[post_contact_count_valuator(mt)] =
+			MakeAtom(label, strlen(label), TRUE);
+	}
+
+	for (i = 0; mt->gestures && i < MT_NUM_GESTURE_VALUATORS; i++) {
+		labels[first + i] = MakeAtom(gesture_labels_str[i],
+					     strlen(gesture_labels_str[i]),
+					     TRUE);
+	}
+
+	if (mt->timestamps) {
+		label = AXIS_LABEL_PROP_MT_FRAME_TIME;
+		labels[post_frame_time_valuator(mt)] =
+			MakeAtom(label, strlen(label), TRUE);
+	}
+
+	for (i = 0 ; i < post_first_frame_valuator(mt); i++) {
+		label = axis_labels_str[mt->axis[i % mt->num_axes]];
+		labels[i] = MakeAtom(label, strlen(label), TRUE);
 	}
 }
 
-static int init_properties(DeviceIntPtr dev)
+static void init_gesture_axes(DeviceIntPtr dev,
+			      const struct mtev_mtouch *mt,
+			      const Atom *labels)
+{
+	const int width = mt->caps.abs_position_x.maximum -
+		mt->caps.abs_position_x.minimum;
+	const int height = mt->caps.abs_position_y.maximum -
+		mt->caps.abs_position_y.minimum;
+	const int range = width > height ? width : height;
+	const int first = post_gesture_valuator(mt);
+	int i;
+
+	xf86InitValuatorAxisStruct(dev, first, labels[first],
+				   -range, range, 1, 0, 1);
+	xf86InitValuatorAxisStruct(dev, first + 1, labels[first + 1],
+				   -range, range, 1, 0, 1);
+	xf86InitValuatorAxisStruct(dev, first + 2, labels[first + 2],
+				   -GESTURE_SCALE_ONE, GESTURE_SCALE_ONE,
+				   1, 0, 1);
+	xf86InitValuatorAxisStruct(dev, first + 3, labels[first + 3],
+				   -GESTURE_ROTATION_HALF, GESTURE_ROTATION_HALF,
+				   1, 0, 1);
+
+	for (i = 0; i < MT_NUM_GESTURE_VALUATORS; i++)
+		xf86InitValuatorDefaults(dev, first + i);
+}
+
+static Atom init_config_property(DeviceIntPtr dev, const char *name,
+				 int format, int size, const void *data)
+{
+	Atom atom = MakeAtom(name, strlen(name), TRUE);
+
+	if (XIChangeDeviceProperty(dev, atom, XA_INTEGER, format,
+				   PropModeReplace, size, data,
+				   FALSE) != Success)
+		return 0;
+
+	XISetDevicePropertyDeletable(dev, atom, FALSE);
+	return atom;
+}
+
+static int init_config_properties(DeviceIntPtr dev,
+				  const struct mtev_mtouch *mt)
+{
+	CARD8 swap_axes = mt->cfg.swap_xy;
+	CARD8 invert_axes[2] = { mt->cfg.invert_x, mt->cfg.invert_y };
+	CARD32 scroll_distance = mt->cfg.scroll_distance;
+	CARD8 palm_size[2] = { mt->cfg.palm_touch_major,
+			       mt->cfg.palm_width_major };
+	CARD32 palm_rejections[2] = { 0, 0 };
+	CARD32 touch_debounce[3] = { mt->cfg.touch_lifetime,
+				     mt->cfg.touch_grace,
+				     mt->cfg.touch_time_ms };
+	CARD32 debounce_counts[2] = { 0, 0 };
+
+	prop_swap_axes = init_config_property(dev, "Swap Axes",
+					      8, 1, &swap_axes);
+	prop_invert_axes = init_config_property(dev, "Invert Axes",
+						8, 2, invert_axes);
+	prop_scroll_distance = init_config_property(dev, "Scroll Distance",
+						    32, 1, &scroll_distance);
+
+	prop_palm_size = init_config_property(dev, "Palm Size",
+					      8, 2, palm_size);
+	prop_palm_rejections = init_config_property(dev, "Palm Rejections",
+						    32, 2, palm_rejections);
+	/* lifetime, grace, and 1 when both are in ms instead of frames */
+	prop_touch_debounce = init_config_property(dev, "Touch Debounce",
+						   32, 3, touch_debounce);
+	/* contacts never posted, frames with a bridged dropout */
+	prop_debounce_counts = init_config_property(dev,
+						    "Touch Debounce Counts",
+						    32, 2, debounce_counts);
+
+	if (!prop_swap_axes || !prop_invert_axes || !prop_scroll_distance ||
+	    !prop_palm_size || !prop_palm_rejections ||
+	    !prop_touch_debounce || !prop_debounce_counts)
+		return BadAlloc;
+
+	return Success;
+}
+
+static int init_properties(DeviceIntPtr dev, const struct mtev_mtouch *mt)
 {
 	static const char* const strMaxContacts = "Max Contacts";
 	static const char* const strAxesPerContact = "Axes Per Contact";
+	static const char* const strFrameValuators = "Frame Valuators";
 	int rc;
 
 	Atom labelMaxContacts;
 	Atom labelAxesPerContact;
+	Atom labelFrameValuators;
 
-	int max_contacts = MT_NUM_FINGERS;
-	int axes_per_contact = MT_AXIS_PER_FINGER;
+	int max_contacts = mt->num_fingers;
+	int axes_per_contact = mt->num_axes;
+	CARD8 frame_valuators[2] = { post_first_frame_valuator(mt),
+				     post_num_frame_valuators(mt) };
 
 	labelMaxContacts = MakeAtom(strMaxContacts,
 				    strlen(strMaxContacts), TRUE);
 	labelAxesPerContact = MakeAtom(strAxesPerContact,
 				       strlen(strAxesPerContact), TRUE);
+	labelFrameValuators = MakeAtom(strFrameValuators,
+				       strlen(strFrameValuators), TRUE);
 
 	rc = XIChangeDeviceProperty(dev,
 				    labelMaxContacts,
@@ -111,95 +374,188 @@ static int init_properties(DeviceIntPtr dev)
 
 	XISetDevicePropertyDeletable(dev, labelAxesPerContact, FALSE);
 
+	/* First valuator after the per contact axes and how many follow */
+	rc = XIChangeDeviceProperty(dev,
+				    labelFrameValuators,
+				    XA_INTEGER,
+				    8,
+				    PropModeReplace,
+				    2,
+				    frame_valuators,
+				    TRUE);
+
+	if (rc != Success)
+		return rc;
+
+	XISetDevicePropertyDeletable(dev, labelFrameValuators, FALSE);
+
+	return Success;
+}
+
+static void read_node_input(int fd, pointer data);
+
+static void close_nodes(LocalDevicePtr local)
+{
+	struct mtev_mtouch *mt = local->private;
+	int i;
+
+	for (i = 1; i < mt->num_nodes; i++) {
+		if (mt->node[i].fd >= 0) {
+			close(mt->node[i].fd);
+			mt->node[i].fd = -1;
+		}
+	}
+
+	if (local->fd >= 0) {
+		xf86CloseSerial(local->fd);
+		local->fd = -1;
+	}
+	mt->node[0].fd = -1;
+}
+
+static int open_nodes(LocalDevicePtr local)
+{
+	struct mtev_mtouch *mt = local->private;
+	int rc;
+	int i;
+
+	local->fd = xf86OpenSerial(local->options);
+	if (local->fd < 0) {
+		xf86Msg(X_ERROR, "mtev: cannot open device\n");
+		return !Success;
+	}
+	mt->node[0].fd = local->fd;
+
+	for (i = 1; i < mt->num_nodes; i++) {
+		struct mtev_node *node = &mt->node[i];
+
+		SYSCALL(node->fd = open(node->path, O_RDWR | O_NONBLOCK, 0));
+		if (node->fd < 0) {
+			xf86Msg(X_ERROR, "mtev: cannot open %s\n", node->path);
+			close_nodes(local);
+			return !Success;
+		}
+	}
+
+	/* Only reprobes nodes whose device changed */
+	rc = mtouch_configure(mt);
+	if (rc == -ENODEV) {
+		xf86Msg(X_ERROR, "mtev: device changed since it was "
+			"initialized, not enabling it\n");
+		close_nodes(local);
+		return !Success;
+	}
+	if (rc) {
+		xf86Msg(X_ERROR, "mtev: cannot configure device\n");
+		close_nodes(local);
+		return !Success;
+	}
+
 	return Success;
 }
 
 static int device_init(DeviceIntPtr dev, LocalDevicePtr local)
 {
 	struct mtev_mtouch *mt = local->private;
+	const int total = post_num_valuators(mt);
 	Atom atom;
 	int i;
 	int j;
-	unsigned char map[MT_NUM_BUTTONS + 1];
-	Atom btn_labels[MT_NUM_BUTTONS] = { 0 };
-	Atom axes_labels[MT_NUM_VALUATORS] = { 0, };
+	const int buttons = num_buttons(mt);
+	unsigned char map[GESTURE_BUTTON_RIGHT + 1];
+	Atom btn_labels[GESTURE_BUTTON_RIGHT] = { 0 };
+	Atom axes_labels[MAX_VALUATORS] = { 0, };
 	int r;
 
-	if (MT_NUM_VALUATORS > MAX_VALUATORS) {
-		xf86Msg(X_ERROR, "MT_NUM_VALUATORS(%d) > MAX_VALUATORS(%d)\n",
-			MT_NUM_VALUATORS, MAX_VALUATORS);
+	if (total > MAX_VALUATORS) {
+		xf86Msg(X_ERROR, "mtev: %d valuators > MAX_VALUATORS(%d)\n",
+			total, MAX_VALUATORS);
 		return BadValue;
 	}
 
-	for (i = 0; i < MT_NUM_BUTTONS; i++)
+	for (i = 0; i < buttons; i++)
 		btn_labels[i] = XIGetKnownProperty(BTN_LABEL_PROP_BTN_UNKNOWN);
 
 	atom = XIGetKnownProperty(BTN_LABEL_PROP_BTN_LEFT);
 	btn_labels[0] = atom;
 
-	init_axes_labels(axes_labels, MT_NUM_VALUATORS);
+	if (mt->gestures) {
+		btn_labels[GESTURE_BUTTON_UP - 1] =
+			XIGetKnownProperty(BTN_LABEL_PROP_BTN_WHEEL_UP);
+		btn_labels[GESTURE_BUTTON_DOWN - 1] =
+			XIGetKnownProperty(BTN_LABEL_PROP_BTN_WHEEL_DOWN);
+		btn_labels[GESTURE_BUTTON_LEFT - 1] =
+			XIGetKnownProperty(BTN_LABEL_PROP_BTN_HWHEEL_LEFT);
+		btn_labels[GESTURE_BUTTON_RIGHT - 1] =
+			XIGetKnownProperty(BTN_LABEL_PROP_BTN_HWHEEL_RIGHT);
+	}
+
+	init_axes_labels(axes_labels, mt);
 
-	r = init_properties(dev);
+	r = init_properties(dev, mt);
 	if (r != Success)
 		return r;
 
-	local->fd = xf86OpenSerial(local->options);
-	if (local->fd < 0) {
-		xf86Msg(X_ERROR, "mtev: cannot open device\n");
-		return !Success;
-	}
-	if (mtouch_configure(mt, local->fd)) {
-		xf86Msg(X_ERROR, "mtev: cannot configure device\n");
-		return !Success;
-	}
-	xf86CloseSerial(local->fd);
+	r = init_config_properties(dev, mt);
+	if (r != Success)
+		return r;
+
+	/* Left open for device_on(), saves a reopen and reprobe */
+	r = open_nodes(local);
+	if (r != Success)
+		return r;
 
-	for (i = 0; i < MT_NUM_BUTTONS+1; i++)
+	warn_debounce(mt, &mt->cfg);
+
+	for (i = 0; i < buttons + 1; i++)
 		map[i] = i;
 
 	InitPointerDeviceStruct((DevicePtr)dev,
 				map,
-				MT_NUM_BUTTONS,
+				buttons,
 				btn_labels,
 				pointer_control,
 				GetMotionHistorySize(),
-				MT_NUM_VALUATORS,
+				total,
 				axes_labels);
 
-	for (i = 0; i < MT_NUM_FINGERS; i++) {
-		for (j = 0; j < MT_AXIS_PER_FINGER; j++) {
-			const int val = (i * MT_AXIS_PER_FINGER) + j;
+	if (post_num_frame_valuators(mt)) {
+		i = post_contact_count_valuator(mt);
+		xf86InitValuatorAxisStruct(dev, i, axes_labels[i],
+					   0, mt->num_fingers, 1, 0, 1);
+		xf86InitValuatorDefaults(dev, i);
+	}
+
+	if (mt->gestures)
+		init_gesture_axes(dev, mt, axes_labels);
+
+	if (mt->timestamps) {
+		i = post_frame_time_valuator(mt);
+		xf86InitValuatorAxisStruct(dev, i, axes_labels[i],
+					   0, 0x7fffffff, 1, 0, 1);
+		xf86InitValuatorDefaults(dev, i);
+	}
+
+	for (i = 0; i < mt->num_fingers; i++) {
+		for (j = 0; j < mt->num_axes; j++) {
+			const int val = (i * mt->num_axes) + j;
 			int min;
 			int max;
 
-			switch (j) {
-			case 0:
+			switch (mt->axis[j]) {
+			case MT_AXIS_POSITION_X:
 				min = mt->caps.abs_position_x.minimum;
 				max = mt->caps.abs_position_x.maximum;
-				if (mt->swap_xy) {
-					mt->min_y = min;
-					mt->max_y = max;
-				} else {
-					mt->min_x = min;
-					mt->max_x = max;
-				}
 				break;
-			case 1:
+			case MT_AXIS_POSITION_Y:
 				min = mt->caps.abs_position_y.minimum;
 				max = mt->caps.abs_position_y.maximum;
-				if (mt->swap_xy) {
-					mt->min_x = min;
-					mt->max_x = max;
-				} else {
-					mt->min_y = min;
-					mt->max_y = max;
-				}
 				break;
-			case 2:
+			case MT_AXIS_TOUCH_MAJOR:
 				min = mt->caps.abs_touch_major.minimum;
 				max = mt->caps.abs_touch_major.maximum;
 				break;
-			case 3:
+			case MT_AXIS_TOUCH_MINOR:
 				if (mt->caps.has_touch_minor) {
 					min = mt->caps.abs_touch_minor.minimum;
 					max = mt->caps.abs_touch_minor.maximum;
@@ -208,7 +564,38 @@ static int device_init(DeviceIntPtr dev, LocalDevicePtr local)
 					max = mt->caps.abs_touch_major.maximum;
 				}
 				break;
-			case 4: // Tracking id
+			case MT_AXIS_WIDTH_MAJOR:
+				min = mt->caps.abs_width_major.minimum;
+				max = mt->caps.abs_width_major.maximum;
+				break;
+			case MT_AXIS_WIDTH_MINOR:
+				if (mt->caps.has_width_minor) {
+					min = mt->caps.abs_width_minor.minimum;
+					max = mt->caps.abs_width_minor.maximum;
+				} else {
+					min = mt->caps.abs_width_major.minimum;
+					max = mt->caps.abs_width_major.maximum;
+				}
+				break;
+			case MT_AXIS_ORIENTATION:
+				min = mt->caps.abs_orientation.minimum;
+				max = mt->caps.abs_orientation.maximum;
+				break;
+			case MT_AXIS_PRESSURE:
+				min = mt->caps.abs_pressure.minimum;
+				max = mt->caps.abs_pressure.maximum;
+				break;
+			case MT_AXIS_VELOCITY_X:
+			case MT_AXIS_VELOCITY_Y:
+				min = -VELOCITY_MAX;
+				max = VELOCITY_MAX;
+				break;
+			case MT_AXIS_ACCELERATION_X:
+			case MT_AXIS_ACCELERATION_Y:
+				min = -ACCELERATION_MAX;
+				max = ACCELERATION_MAX;
+				break;
+			case MT_AXIS_TRACKING_ID:
 				min = mt->caps.abs_tracking_id.minimum;
 				max = mt->caps.abs_tracking_id.maximum >
 					(MT_NUM_FINGERS-1) ?
@@ -227,121 +614,368 @@ static int device_init(DeviceIntPtr dev, LocalDevicePtr local)
 		}
 	}
 
-	XIRegisterPropertyHandler(dev, pointer_property, NULL, NULL);
+	XIRegisterPropertyHandler(dev, pointer_property, get_property, NULL);
+
+	if (mt->pen_routing)
+		pen_create(local);
+
+	/* The valuator ranges now belong to this device */
+	mt->caps_locked = 1;
 
 	return Success;
 }
 
+/* Index of the output of that name on the screen, or -1 */
+static int find_output(rrScrPrivPtr rr, const char *name)
+{
+	int i;
+
+	for (i = 0; rr && i < rr->numOutputs; i++)
+		if (!strcmp(rr->outputs[i]->name, name))
+			return i;
+
+	return -1;
+}
+
+/* Area of the named output as fractions of its screen */
+static void map_to_output(LocalDevicePtr local)
+{
+	struct mtev_mtouch *mt = local->private;
+	const ScreenPtr screen = screenInfo.screens[mt->output_screen];
+	rrScrPrivPtr rr = rrGetScrPriv(screen);
+	struct mtev_config cfg = mt->cfg_shadow;
+	RRCrtcPtr crtc = NULL;
+	bool mapped = 0;
+	int width = 0;
+	int height = 0;
+	int sigstate;
+	int i;
+
+	i = find_output(rr, mt->output_name);
+	if (i >= 0)
+		crtc = rr->outputs[i]->crtc;
+
+	cfg.output_x = cfg.output_y = 0;
+	cfg.output_width = cfg.output_height = MT_OUTPUT_FULL;
+
+	if (crtc && crtc->mode && screen->width > 0 && screen->height > 0) {
+		width = crtc->mode->mode.width;
+		height = crtc->mode->mode.height;
+		if (crtc->rotation & (RR_Rotate_90 | RR_Rotate_270)) {
+			width = crtc->mode->mode.height;
+			height = crtc->mode->mode.width;
+		}
+
+		cfg.output_x = ((long long)crtc->x << 16) / screen->width;
+		cfg.output_y = ((long long)crtc->y << 16) / screen->height;
+		cfg.output_width = ((long long)width << 16) / screen->width;
+		cfg.output_height = ((long long)height << 16) / screen->height;
+		mapped = 1;
+	}
+
+	/* Every CRTC change lands here, most leave our output alone */
+	if (cfg.output_x == mt->cfg_shadow.output_x &&
+	    cfg.output_y == mt->cfg_shadow.output_y &&
+	    cfg.output_width == mt->cfg_shadow.output_width &&
+	    cfg.output_height == mt->cfg_shadow.output_height)
+		return;
+
+	if (mapped)
+		xf86Msg(X_INFO, "mtev: mapped to %s at %dx%d+%d+%d\n",
+			mt->output_name, width, height, crtc->x, crtc->y);
+	else
+		xf86Msg(X_WARNING, "mtev: output %s is not active, "
+			"mapping to the whole screen\n", mt->output_name);
+
+	sigstate = xf86BlockSIGIO();
+	mtouch_set_config(mt, &cfg);
+	xf86UnblockSIGIO(sigstate);
+}
+
+/*
+ * RandR procs of each screen, wrapped once while any device follows
+ * one of its outputs. Only RandR 1.2 drivers have outputs to follow.
+ */
+struct output_wrap {
+	RRCrtcSetProcPtr crtc_set;
+	RRScreenSetSizeProcPtr screen_set_size;
+	bool wrapped;
+	int users;
+};
+
+static struct output_wrap output_wraps[MAXSCREENS];
+
+static Bool device_control(DeviceIntPtr dev, int mode);
+
+static void remap_outputs(ScreenPtr screen)
+{
+	LocalDevicePtr local;
+
+	for (local = xf86FirstLocalDevice(); local; local = local->next) {
+		struct mtev_mtouch *mt = local->private;
+
+		if (local->device_control == device_control && mt &&
+		    mt->output_active && mt->output_screen == screen->myNum)
+			map_to_output(local);
+	}
+}
+
+static Bool output_crtc_set_hook(ScreenPtr screen, RRCrtcPtr crtc,
+				 RRModePtr mode, int x, int y,
+				 Rotation rotation, int num_outputs,
+				 RROutputPtr *outputs)
+{
+	struct output_wrap *wrap = &output_wraps[screen->myNum];
+	Bool ret = wrap->crtc_set(screen, crtc, mode, x, y, rotation,
+				  num_outputs, outputs);
+
+	remap_outputs(screen);
+	return ret;
+}
+
+static Bool output_screen_set_size_hook(ScreenPtr screen,
+					CARD16 width, CARD16 height,
+					CARD32 mm_width, CARD32 mm_height)
+{
+	struct output_wrap *wrap = &output_wraps[screen->myNum];
+	Bool ret = wrap->screen_set_size(screen, width, height,
+					 mm_width, mm_height);
+
+	remap_outputs(screen);
+	return ret;
+}
+
+static void follow_output(LocalDevicePtr local)
+{
+	struct mtev_mtouch *mt = local->private;
+	struct output_wrap *wrap;
+	rrScrPrivPtr rr = NULL;
+	int i;
+
+	for (i = 0; i < screenInfo.numScreens; i++) {
+		rr = rrGetScrPriv(screenInfo.screens[i]);
+		if (find_output(rr, mt->output_name) >= 0)
+			break;
+	}
+	if (i == screenInfo.numScreens) {
+		xf86Msg(X_WARNING, "mtev: no output %s, ignoring "
+			"MapToOutput\n", mt->output_name);
+		return;
+	}
+
+	if (!rr->rrCrtcSet || !rr->rrScreenSetSize) {
+		xf86Msg(X_WARNING, "mtev: no RandR 1.2 on screen %d, "
+			"ignoring MapToOutput\n", i);
+		return;
+	}
+
+	wrap = &output_wraps[i];
+	if (!wrap->wrapped) {
+		wrap->crtc_set = rr->rrCrtcSet;
+		wrap->screen_set_size = rr->rrScreenSetSize;
+		rr->rrCrtcSet = output_crtc_set_hook;
+		rr->rrScreenSetSize = output_screen_set_size_hook;
+		wrap->wrapped = 1;
+	}
+	wrap->users++;
+
+	mt->output_screen = i;
+	mt->output_active = 1;
+	map_to_output(local);
+}
+
+static void unfollow_output(LocalDevicePtr local)
+{
+	struct mtev_mtouch *mt = local->private;
+	struct output_wrap *wrap = &output_wraps[mt->output_screen];
+	rrScrPrivPtr rr;
+
+	if (!mt->output_active)
+		return;
+	mt->output_active = 0;
+
+	// Stay wrapped if someone wrapped on top of us, the hooks just chain
+	rr = rrGetScrPriv(screenInfo.screens[mt->output_screen]);
+	if (--wrap->users || !rr ||
+	    rr->rrCrtcSet != output_crtc_set_hook ||
+	    rr->rrScreenSetSize != output_screen_set_size_hook)
+		return;
+
+	rr->rrCrtcSet = wrap->crtc_set;
+	rr->rrScreenSetSize = wrap->screen_set_size;
+	wrap->wrapped = 0;
+}
+
 static int device_on(LocalDevicePtr local)
 {
 	struct mtev_mtouch *mt = local->private;
-	local->fd = xf86OpenSerial(local->options);
-	if (local->fd < 0) {
-		xf86Msg(X_ERROR, "mtev: cannot open device\n");
+	int i;
+
+	if (local->fd < 0 && open_nodes(local) != Success)
 		return !Success;
-	}
-	if (mtouch_open(mt, local->fd)) {
+
+	if (mtouch_open(mt)) {
 		xf86Msg(X_ERROR, "mtev: cannot grab device\n");
 		return !Success;
 	}
+
+	/* Allocated here, only armed from the input path */
+	mt->debounce_timer = TimerSet(NULL, 0, 0, NULL, NULL);
+	mt->debounce_armed = 0;
+
+	if (mt->output_name)
+		follow_output(local);
 	xf86AddEnabledDevice(local);
+	for (i = 1; i < mt->num_nodes; i++)
+		mt->node[i].handler = xf86AddInputHandler(mt->node[i].fd,
+							  read_node_input,
+							  local);
 	return Success;
 }
 
 static int device_off(LocalDevicePtr local)
 {
 	struct mtev_mtouch *mt = local->private;
+	int i;
+
+	for (i = 1; i < mt->num_nodes; i++) {
+		if (mt->node[i].handler) {
+			xf86RemoveInputHandler(mt->node[i].handler);
+			mt->node[i].handler = NULL;
+		}
+	}
 	xf86RemoveEnabledDevice(local);
-	if(mtouch_close(mt, local->fd)) {
+	if (mt->debounce_timer) {
+		TimerFree(mt->debounce_timer);
+		mt->debounce_timer = NULL;
+	}
+	unfollow_output(local);
+	if (mt->palm.rejected_contacts)
+		xf86Msg(X_INFO, "mtev: rejected %lu palm contacts in %lu frames\n",
+			mt->palm.rejected_contacts, mt->palm.rejected_frames);
+	if (mt->debounce.suppressed_contacts || mt->debounce.bridged_frames)
+		xf86Msg(X_INFO, "mtev: suppressed %lu short contacts, "
+			"bridged %lu frames\n",
+			mt->debounce.suppressed_contacts,
+			mt->debounce.bridged_frames);
+	if(mtouch_close(mt)) {
 		xf86Msg(X_WARNING, "mtev: cannot ungrab device\n");
 	}
-	xf86CloseSerial(local->fd);
+	close_nodes(local);
 	return Success;
 }
 
 static int device_close(LocalDevicePtr local)
 {
+	struct mtev_mtouch *mt = local->private;
+
+	/* Initialized but never switched on */
+	close_nodes(local);
+	mt->caps_locked = 0;
 	return Success;
 }
 
-static void process_state(LocalDevicePtr local,
-			  const struct mtev_mtouch *mt)
+static void post_clicks(LocalDevicePtr local, int clicks,
+			int negative, int positive)
 {
+	const int button = clicks < 0 ? negative : positive;
 
-	const struct mtev_touch_point *tp;
-	static int pdown = 0;
-	int valuators[MAX_VALUATORS];
-	int down;
-	int valix;
-	int contacts;
-
-	contacts = valix = down = 0;
+	if (clicks < 0)
+		clicks = -clicks;
 
-	while ((tp = mtouch_get_contact(mt, contacts)) != NULL) {
-		contacts++;
+	while (clicks--) {
+		xf86PostButtonEvent(local->dev, TRUE, button, 1, 0, 0);
+		xf86PostButtonEvent(local->dev, TRUE, button, 0, 0, 0);
+	}
+}
 
-		// We don't do remapping of tracking id's so
-		// make sure clients don't see too high tracking_id numbers
-		if (tp->tracking_id < MT_NUM_FINGERS) {
-			int x;
-			int y;
+static void process_state(LocalDevicePtr local,
+			  struct mtev_mtouch *mt)
+{
+	struct mtev_post post;
+	int *valuators = mt->valuators;
 
-			x = tp->position_x;
-			y = tp->position_y;
+	post_frame(mt, &post);
 
-			if (mt->swap_xy) {
-				const int tmp = y;
-				y = x;
-				x = tmp;
-			}
+	/* Some x-clients assume they get motion events before button down */
+	if (post.down)
+		xf86PostMotionEventP(local->dev, TRUE,
+				     0, post.num_valuators, valuators);
 
-			if (mt->invert_x)
-				x = mt->max_x - x + mt->min_x;
+	if (post.button > 0)
+		xf86PostButtonEventP(local->dev, TRUE,
+				     1, 1,
+				     0, post.num_valuators, valuators);
+	else if (post.button < 0)
+		xf86PostButtonEventP(local->dev, TRUE,
+				     1, 0,
+				     0, post.num_valuators, valuators);
 
-			if (mt->invert_y)
-				y = mt->max_y - y + mt->min_y;
+	if (mt->pen_local)
+		pen_post(mt, post.pen, post.pen_x, post.pen_y,
+			 post.pen_pressure);
 
-			valuators[valix++] = x;
-			valuators[valix++] = y;
-			valuators[valix++] = tp->touch_major;
+	/* Button transition: 1 press, -1 release, 0 none */
+	PROBE3(post, post.down, post.button, post.num_valuators);
 
-			if (mt->caps.has_touch_minor)
-				valuators[valix++] = tp->touch_minor;
-			else
-				valuators[valix++] = tp->touch_major;
+	if (mt->gestures) {
+		post_clicks(local, post.clicks_y,
+			    GESTURE_BUTTON_UP, GESTURE_BUTTON_DOWN);
+		post_clicks(local, post.clicks_x,
+			    GESTURE_BUTTON_LEFT, GESTURE_BUTTON_RIGHT);
+	}
+}
 
-			valuators[valix++] = tp->tracking_id;
+/* Ends bridged contacts when the device stops sending frames */
+static CARD32 expire_contacts(OsTimerPtr timer, CARD32 now, pointer arg)
+{
+	LocalDevicePtr local = arg;
+	struct mtev_mtouch *mt = local->private;
+	int sigstate = xf86BlockSIGIO();
 
-			down++;
-		}
+	mt->debounce_armed = 0;
+	if (mtouch_expire_contacts(mt))
+		process_state(local, mt);
 
-		// Don't deliver more than MaxContacts
-		if (down >= MT_NUM_FINGERS)
-			break;
-	}
+	xf86UnblockSIGIO(sigstate);
+	return 0;
+}
 
-	/* Some x-clients assume they get motion events before button down */
-	if (down)
-		xf86PostMotionEventP(local->dev, TRUE,
-				     0, down * MT_AXIS_PER_FINGER, valuators);
+static void read_node(LocalDevicePtr local, int fd)
+{
+	struct mtev_mtouch *mt = local->private;
+	int timeout;
 
-	if(down && pdown == 0)
-		xf86PostButtonEventP(local->dev, TRUE,
-				     1, 1,
-				     0, down * MT_AXIS_PER_FINGER, valuators);
-	else if (down == 0 && pdown)
-		xf86PostButtonEvent(local->dev, TRUE, 1, 0, 0, 0);
+	while (mtouch_read_synchronized_event(mt, fd)) {
+		process_state(local, mt);
+	}
 
-	pdown = !!down;
+	if (!mt->debounce_timer)
+		return;
+
+	timeout = mtouch_expire_timeout(mt);
+	if (timeout) {
+		TimerSet(mt->debounce_timer, 0, timeout,
+			 expire_contacts, local);
+		mt->debounce_armed = 1;
+	} else if (mt->debounce_armed) {
+		TimerCancel(mt->debounce_timer);
+		mt->debounce_armed = 0;
+	}
 }
 
 /* called for each full received packet from the touchpad */
 static void read_input(LocalDevicePtr local)
 {
-	struct mtev_mtouch *mt = local->private;
-	while (mtouch_read_synchronized_event(mt, local->fd)) {
-		process_state(local, mt);
-	}
+	read_node(local, local->fd);
+}
+
+/* Extra nodes are read from the main loop, keep SIGIO reads out */
+static void read_node_input(int fd, pointer data)
+{
+	int sigstate = xf86BlockSIGIO();
+	read_node(data, fd);
+	xf86UnblockSIGIO(sigstate);
 }
 
 static Bool device_control(DeviceIntPtr dev, int mode)
@@ -366,9 +1000,102 @@ static Bool device_control(DeviceIntPtr dev, int mode)
 	}
 }
 
+static bool parse_tile(LocalDevicePtr local, struct mtev_node *node, int n)
+{
+	char name[16];
+	char *tile;
+
+	snprintf(name, sizeof(name), "Tile%d", n);
+	tile = xf86SetStrOption(local->options, name, NULL);
+	if (!tile)
+		return 1;
+
+	node->has_tile = sscanf(tile, "%d %d %d %d",
+				&node->tile_x, &node->tile_y,
+				&node->tile_width, &node->tile_height) == 4 &&
+		node->tile_width > 0 && node->tile_height > 0;
+	if (!node->has_tile)
+		xf86Msg(X_ERROR, "mtev: %s wants \"x y width height\"\n", name);
+
+	free(tile);
+	return node->has_tile;
+}
+
+/*
+ * Device1 .. Device5 add more evdev nodes to the same logical
+ * surface, TileN places node N in the shared coordinate space.
+ */
+static int parse_nodes(LocalDevicePtr local, struct mtev_mtouch *mt)
+{
+	char name[16];
+	int i;
+
+	mt->num_nodes = 1;
+	for (i = 1; i < MT_MAX_NODES; i++) {
+		snprintf(name, sizeof(name), "Device%d", i);
+		mt->node[i].path = xf86SetStrOption(local->options, name, NULL);
+		if (!mt->node[i].path)
+			break;
+		mt->num_nodes++;
+	}
+
+	for (i = 0; i < mt->num_nodes && mt->num_nodes > 1; i++)
+		if (!parse_tile(local, &mt->node[i], i))
+			return -1;
+
+	return 0;
+}
+
+/* Paths of the extra nodes come from xf86SetStrOption() */
+static void free_nodes(struct mtev_mtouch *mt)
+{
+	int i;
+
+	for (i = 1; i < mt->num_nodes; i++) {
+		free((char *)mt->node[i].path);
+		mt->node[i].path = NULL;
+	}
+}
+
+/* "Axes" is a space separated list of names from axis_names */
+static int parse_axes(LocalDevicePtr local, struct mtev_mtouch *mt)
+{
+	char *axes = xf86SetStrOption(local->options, "Axes", DEFAULT_AXES);
+	char *name;
+	char *save;
+	int i;
+
+	mt->num_axes = 0;
+	for (name = strtok_r(axes, " ,", &save); name;
+	     name = strtok_r(NULL, " ,", &save)) {
+		for (i = 0; i < MT_AXIS_COUNT; i++)
+			if (!strcmp(name, axis_names[i]))
+				break;
+
+		if (i == MT_AXIS_COUNT) {
+			xf86Msg(X_ERROR, "mtev: unknown axis %s\n", name);
+			break;
+		}
+		if (mt->num_axes == MT_AXIS_COUNT) {
+			xf86Msg(X_ERROR, "mtev: too many axes\n");
+			break;
+		}
+		mt->axis[mt->num_axes++] = i;
+
+		if (i >= MT_AXIS_VELOCITY_X && i <= MT_AXIS_ACCELERATION_Y)
+			mt->velocity_axes = 1;
+	}
+
+	free(axes);
+	return name || !mt->num_axes ? -1 : 0;
+}
+
 static InputInfoPtr preinit(InputDriverPtr drv, IDevPtr dev, int flags)
 {
 	struct mtev_mtouch *mt;
+	char *pen_of;
+	char *unit;
+	int i;
 	InputInfoPtr local = xf86AllocateInput(drv, 0);
 	if (!local)
 		goto error;
@@ -381,6 +1108,9 @@ static InputInfoPtr preinit(InputDriverPtr drv, IDevPtr dev, int flags)
 	local->device_control = device_control;
 	local->read_input = read_input;
 	local->private = mt;
+	local->fd = -1;
+	for (i = 0; i < MT_MAX_NODES; i++)
+		mt->node[i].fd = -1;
 	local->flags = XI86_POINTER_CAPABLE |
 		XI86_SEND_DRAG_EVENTS;
 
@@ -390,10 +1120,73 @@ static InputInfoPtr preinit(InputDriverPtr drv, IDevPtr dev, int flags)
 	//xf86OptionListReport(local->options);
 	xf86ProcessCommonOptions(local, local->options);
 
+	/* Pen device created by pen_create() for another device */
+	pen_of = xf86CheckStrOption(local->options, "PenOf", NULL);
+	if (pen_of) {
+		free(mt);
+		local->private = NULL;
+		pen_preinit(local, pen_of);
+		free(pen_of);
+		return local;
+	}
 
-	mt->swap_xy = xf86SetBoolOption(local->options, "SwapAxes", FALSE);
-	mt->invert_x = xf86SetBoolOption(local->options, "InvertX", FALSE);
-	mt->invert_y = xf86SetBoolOption(local->options, "InvertY", FALSE);
+	mt->cfg.swap_xy = xf86SetBoolOption(local->options, "SwapAxes", FALSE);
+	mt->cfg.invert_x = xf86SetBoolOption(local->options, "InvertX", FALSE);
+	mt->cfg.invert_y = xf86SetBoolOption(local->options, "InvertY", FALSE);
+	mt->cfg.scroll_distance = xf86SetIntOption(local->options,
+						   "ScrollDistance", 100);
+	if (mt->cfg.scroll_distance < 1)
+		mt->cfg.scroll_distance = 1;
+	mt->cfg.palm_touch_major = xf86SetIntOption(local->options,
+						    "PalmTouchMajor", 0);
+	mt->cfg.palm_width_major = xf86SetIntOption(local->options,
+						    "PalmWidthMajor", 0);
+	if (mt->cfg.palm_touch_major < 0 || mt->cfg.palm_touch_major > 100)
+		mt->cfg.palm_touch_major = 0;
+	if (mt->cfg.palm_width_major < 0 || mt->cfg.palm_width_major > 100)
+		mt->cfg.palm_width_major = 0;
+	mt->cfg.touch_lifetime = xf86SetIntOption(local->options,
+						  "TouchMinLifetime", 0);
+	mt->cfg.touch_grace = xf86SetIntOption(local->options,
+					       "TouchReleaseGrace", 0);
+	if (mt->cfg.touch_lifetime < 0)
+		mt->cfg.touch_lifetime = 0;
+	if (mt->cfg.touch_grace < 0)
+		mt->cfg.touch_grace = 0;
+	unit = xf86SetStrOption(local->options, "TouchDebounceUnit", "frames");
+	mt->cfg.touch_time_ms = unit && !strcmp(unit, "ms");
+	free(unit);
+	mt->cfg.output_width = MT_OUTPUT_FULL;
+	mt->cfg.output_height = MT_OUTPUT_FULL;
+	mt->cfg_shadow = mt->cfg;
+
+	palm_init(&mt->palm);
+	debounce_init(&mt->debounce);
+
+	mt->gestures = xf86SetBoolOption(local->options, "Gestures", FALSE);
+	mt->num_fingers = xf86SetIntOption(local->options, "MaxContacts",
+					   MT_NUM_FINGERS);
+	if (mt->num_fingers < 1 || mt->num_fingers > MT_NUM_FINGERS)
+		mt->num_fingers = MT_NUM_FINGERS;
+	mt->timestamps = xf86SetBoolOption(local->options, "Timestamps", FALSE);
+	mt->grab = xf86SetBoolOption(local->options, "GrabDevice", TRUE);
+	mt->output_name = xf86SetStrOption(local->options, "MapToOutput", NULL);
+	mt->pen_routing = xf86SetBoolOption(local->options,
+					    "PenDevice", FALSE);
+	gesture_init(&mt->gesture, mt->cfg.scroll_distance);
+
+	if (parse_axes(local, mt))
+		goto error;
+
+	if (mt->num_fingers > post_max_fingers(mt)) {
+		xf86Msg(X_WARNING, "mtev: %d axes per contact, only %d "
+			"contacts fit in %d valuators\n", mt->num_axes,
+			post_max_fingers(mt), MAX_VALUATORS);
+		mt->num_fingers = post_max_fingers(mt);
+	}
+
+	if (parse_nodes(local, mt))
+		goto error;
 
 	local->flags |= XI86_CONFIGURED;
 
@@ -403,6 +1196,19 @@ error:
 
 static void uninit(InputDriverPtr drv, InputInfoPtr local, int flags)
 {
+	struct mtev_mtouch *mt = local->private;
+
+	if (pen_is(local)) {
+		pen_uninit(local);
+		xf86DeleteInput(local, 0);
+		return;
+	}
+
+	if (mt) {
+		pen_detach(local);
+		free_nodes(mt);
+		free(mt->output_name);
+	}
 	free(local->private);
 	local->private = NULL;
 	xf86DeleteInput(local, 0);
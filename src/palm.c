@@ -0,0 +1,91 @@
+/***************************************************************************
+ *
+ * Multitouch protocol X driver
+ * Copyright (C) 2008 Henrik Rydberg <rydberg@euromail.se>
+ * Copyright (C) 2009,2010 Nokia Corporation
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ **************************************************************************/
+
+#include <string.h>
+
+#include "palm.h"
+
+void palm_init(struct mtev_palm *palm)
+{
+	memset(palm, 0, sizeof(struct mtev_palm));
+}
+
+/* Forget tracked palms, limits and counters are kept */
+void palm_reset(struct mtev_palm *palm)
+{
+	palm->num_palms = 0;
+}
+
+static bool was_palm(const struct mtev_palm *palm, int tracking_id)
+{
+	int i;
+
+	for (i = 0; i < palm->num_palms; i++)
+		if (palm->palm_id[i] == tracking_id)
+			return 1;
+
+	return 0;
+}
+
+static bool is_palm(const struct mtev_palm *palm,
+		    const struct mtev_touch_point *tp)
+{
+	return (palm->max_touch_major &&
+		tp->touch_major > palm->max_touch_major) ||
+		(palm->max_width_major &&
+		 tp->width_major > palm->max_width_major);
+}
+
+void palm_filter(struct mtev_palm *palm, struct mtev_hw_state *hw)
+{
+	int palm_id[HW_MAX_CONTACTS];
+	int num_palms = 0;
+	int kept = 0;
+	int i;
+
+	if (!palm->max_touch_major && !palm->max_width_major &&
+	    !palm->num_palms)
+		return;
+
+	for (i = 0; i < hw->num_contacts; i++) {
+		const struct mtev_touch_point *tp = &hw->contact[i];
+
+		if ((palm->track_ids && was_palm(palm, tp->tracking_id)) ||
+		    is_palm(palm, tp)) {
+			palm_id[num_palms++] = tp->tracking_id;
+			continue;
+		}
+
+		if (kept != i)
+			hw->contact[kept] = *tp;
+		kept++;
+	}
+
+	if (num_palms) {
+		palm->rejected_contacts += num_palms;
+		palm->rejected_frames++;
+	}
+
+	hw->num_contacts = kept;
+	memcpy(palm->palm_id, palm_id, num_palms * sizeof(int));
+	palm->num_palms = num_palms;
+}
@@ -0,0 +1,53 @@
+/***************************************************************************
+ *
+ * Multitouch protocol X driver
+ * Copyright (C) 2008 Henrik Rydberg <rydberg@euromail.se>
+ * Copyright (C) 2009,2010 Nokia Corporation
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ **************************************************************************/
+
+#ifndef PALM_H
+#define PALM_H
+
+#include "hw.h"
+
+/*
+ * Drops oversized contacts from a frame. A contact that is rejected
+ * once stays rejected until its tracking id lifts, so a palm is not
+ * let through while it shrinks on the way up. Devices without tracking
+ * ids only get the size check.
+ */
+struct mtev_palm {
+	/* Limits in device units, 0 disables the check */
+	int max_touch_major;
+	int max_width_major;
+
+	/* Without tracking ids a rejection cannot follow its contact */
+	bool track_ids;
+
+	int palm_id[HW_MAX_CONTACTS];
+	int num_palms;
+
+	unsigned long rejected_contacts;
+	unsigned long rejected_frames;
+};
+
+void palm_init(struct mtev_palm *palm);
+void palm_reset(struct mtev_palm *palm);
+void palm_filter(struct mtev_palm *palm, struct mtev_hw_state *hw);
+
+#endif
@@ -0,0 +1,327 @@
+/***************************************************************************
+ *
+ * Multitouch X driver
+ * Copyright (C) 2008 Henrik Rydberg <rydberg@euromail.se>
+ * Copyright (C) 2009,2010 Nokia Corporation
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ **************************************************************************/
+
+#include "xorg-server.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <xorg/exevents.h>
+#include <xorg/xserver-properties.h>
+#include <xf86.h>
+#include <xf86_OSproc.h>
+#include <xf86Xinput.h>
+
+#include "pen.h"
+
+#define PEN_NUM_AXES    3
+#define PEN_NUM_BUTTONS 1
+
+struct mtev_pen {
+	LocalDevicePtr parent;
+};
+
+static Bool pen_control(DeviceIntPtr dev, int mode);
+
+bool pen_is(LocalDevicePtr local)
+{
+	return local->device_control == pen_control;
+}
+
+static void pen_ptr_ctrl(DeviceIntPtr dev, PtrCtrl *ctrl)
+{
+}
+
+static void pen_read_input(LocalDevicePtr local)
+{
+}
+
+static int pen_init(DeviceIntPtr dev, LocalDevicePtr local)
+{
+	struct mtev_pen *pen = local->private;
+	struct mtev_mtouch *mt;
+	unsigned char map[PEN_NUM_BUTTONS + 1] = { 0, 1 };
+	Atom btn_labels[PEN_NUM_BUTTONS];
+	Atom axes_labels[PEN_NUM_AXES];
+	int min_pressure = 0;
+	int max_pressure = 1;
+	int i;
+
+	if (!pen->parent)
+		return !Success;
+	mt = pen->parent->private;
+
+	if (mt->caps.has_pressure) {
+		min_pressure = mt->caps.abs_pressure.minimum;
+		max_pressure = mt->caps.abs_pressure.maximum;
+	}
+
+	btn_labels[0] = XIGetKnownProperty(BTN_LABEL_PROP_BTN_LEFT);
+	axes_labels[0] = XIGetKnownProperty(AXIS_LABEL_PROP_ABS_X);
+	axes_labels[1] = XIGetKnownProperty(AXIS_LABEL_PROP_ABS_Y);
+	axes_labels[2] = XIGetKnownProperty(AXIS_LABEL_PROP_ABS_PRESSURE);
+
+	InitPointerDeviceStruct((DevicePtr)dev,
+				map,
+				PEN_NUM_BUTTONS,
+				btn_labels,
+				pen_ptr_ctrl,
+				GetMotionHistorySize(),
+				PEN_NUM_AXES,
+				axes_labels);
+
+	/* The ranges pen_post() positions are in, after swap and mapping */
+	xf86InitValuatorAxisStruct(dev, 0, axes_labels[0],
+				   mt->min_x, mt->max_x,
+				   1, 0, 1);
+	xf86InitValuatorAxisStruct(dev, 1, axes_labels[1],
+				   mt->min_y, mt->max_y,
+				   1, 0, 1);
+	xf86InitValuatorAxisStruct(dev, 2, axes_labels[2],
+				   min_pressure, max_pressure,
+				   1, 0, 1);
+
+	for (i = 0; i < PEN_NUM_AXES; i++)
+		xf86InitValuatorDefaults(dev, i);
+
+	return Success;
+}
+
+/* The pen has no fd of its own, the touch device posts for it */
+static void pen_enable(LocalDevicePtr local, bool on)
+{
+	struct mtev_pen *pen = local->private;
+	struct mtev_mtouch *mt;
+	int sigstate;
+
+	if (!pen->parent)
+		return;
+	mt = pen->parent->private;
+
+	sigstate = xf86BlockSIGIO();
+	mt->pen_on = on;
+	mt->pen_down = 0;
+	xf86UnblockSIGIO(sigstate);
+}
+
+static Bool pen_control(DeviceIntPtr dev, int mode)
+{
+	LocalDevicePtr local = dev->public.devicePrivate;
+	struct mtev_pen *pen = local->private;
+
+	switch (mode) {
+	case DEVICE_INIT:
+		return pen_init(dev, local);
+	case DEVICE_ON:
+		if (!pen->parent)
+			return !Success;
+		pen_enable(local, 1);
+		return Success;
+	case DEVICE_OFF:
+		pen_enable(local, 0);
+		return Success;
+	case DEVICE_CLOSE:
+		return Success;
+	default:
+		return BadValue;
+	}
+}
+
+void pen_post(struct mtev_mtouch *mt, bool down, int x, int y, int pressure)
+{
+	LocalDevicePtr local = mt->pen_local;
+	int valuators[PEN_NUM_AXES];
+
+	if (!mt->pen_on)
+		return;
+
+	valuators[0] = x;
+	valuators[1] = y;
+	valuators[2] = pressure;
+
+	if (down) {
+		xf86PostMotionEventP(local->dev, TRUE,
+				     0, PEN_NUM_AXES, valuators);
+		if (!mt->pen_down)
+			xf86PostButtonEventP(local->dev, TRUE, 1, 1,
+					     0, PEN_NUM_AXES, valuators);
+	} else if (mt->pen_down) {
+		xf86PostButtonEvent(local->dev, TRUE, 1, 0, 0, 0);
+	}
+
+	mt->pen_down = down;
+}
+
+static LocalDevicePtr find_parent(LocalDevicePtr local, const char *name)
+{
+	LocalDevicePtr parent;
+
+	for (parent = xf86FirstLocalDevice(); parent; parent = parent->next) {
+		if (parent != local && parent->drv == local->drv &&
+		    !pen_is(parent) && parent->private &&
+		    !strcmp(parent->name, name))
+			return parent;
+	}
+
+	return NULL;
+}
+
+/* Runs from the main loop, devices cannot be added from DEVICE_INIT */
+static Bool create_pen(ClientPtr client, pointer closure)
+{
+	char *parent_name = closure;
+	char name[256];
+	InputAttributes attrs;
+	InputOption options[3];
+	DeviceIntPtr dev;
+
+	snprintf(name, sizeof(name), "%s Pen", parent_name);
+
+	options[0].key = (char *)"driver";
+	options[0].value = (char *)"mtev";
+	options[0].next = &options[1];
+	options[1].key = (char *)"identifier";
+	options[1].value = name;
+	options[1].next = &options[2];
+	options[2].key = (char *)"PenOf";
+	options[2].value = parent_name;
+	options[2].next = NULL;
+
+	memset(&attrs, 0, sizeof(attrs));
+
+	if (NewInputDeviceRequest(options, &attrs, &dev) != Success)
+		xf86Msg(X_ERROR, "mtev: cannot create %s\n", name);
+
+	free(parent_name);
+	return TRUE;
+}
+
+void pen_create(LocalDevicePtr parent)
+{
+	struct mtev_mtouch *mt = parent->private;
+	char *name;
+
+	if (mt->pen_local || mt->pen_queued)
+		return;
+
+	name = strdup(parent->name);
+	if (!name)
+		return;
+
+	mt->pen_queued = 1;
+	QueueWorkProc(create_pen, NULL, name);
+}
+
+/* Runs from the main loop, a device cannot remove another from UnInit */
+static Bool remove_pen(ClientPtr client, pointer closure)
+{
+	char *name = closure;
+	LocalDevicePtr local;
+
+	for (local = xf86FirstLocalDevice(); local; local = local->next) {
+		struct mtev_pen *pen = local->private;
+
+		if (pen_is(local) && pen && !pen->parent && local->dev &&
+		    !strcmp(local->name, name)) {
+			DeleteInputDeviceRequest(local->dev);
+			break;
+		}
+	}
+
+	free(name);
+	return TRUE;
+}
+
+/* The pen goes away with its parent */
+void pen_detach(LocalDevicePtr parent)
+{
+	struct mtev_mtouch *mt = parent->private;
+	LocalDevicePtr local = mt->pen_local;
+	struct mtev_pen *pen;
+	char *name;
+
+	if (!local)
+		return;
+
+	pen = local->private;
+	pen->parent = NULL;
+	mt->pen_local = NULL;
+	mt->pen_on = 0;
+
+	name = strdup(local->name);
+	if (name)
+		QueueWorkProc(remove_pen, NULL, name);
+}
+
+InputInfoPtr pen_preinit(LocalDevicePtr local, const char *parent_name)
+{
+	LocalDevicePtr parent = find_parent(local, parent_name);
+	struct mtev_mtouch *mt;
+	struct mtev_pen *pen;
+
+	if (!parent) {
+		xf86Msg(X_ERROR, "mtev: no device %s for pen\n", parent_name);
+		return local;
+	}
+
+	mt = parent->private;
+	if (mt->pen_local) {
+		xf86Msg(X_ERROR, "mtev: %s already has a pen\n", parent_name);
+		return local;
+	}
+
+	pen = calloc(1, sizeof(struct mtev_pen));
+	if (!pen)
+		return local;
+
+	pen->parent = parent;
+	mt->pen_local = local;
+	mt->pen_queued = 0;
+
+	local->type_name = XI_TABLET;
+	local->device_control = pen_control;
+	local->read_input = pen_read_input;
+	local->private = pen;
+	local->fd = -1;
+	local->flags = XI86_POINTER_CAPABLE | XI86_SEND_DRAG_EVENTS |
+		XI86_CONFIGURED;
+
+	return local;
+}
+
+void pen_uninit(LocalDevicePtr local)
+{
+	struct mtev_pen *pen = local->private;
+	struct mtev_mtouch *mt;
+	int sigstate;
+
+	if (pen && pen->parent) {
+		mt = pen->parent->private;
+
+		sigstate = xf86BlockSIGIO();
+		mt->pen_on = 0;
+		mt->pen_local = NULL;
+		xf86UnblockSIGIO(sigstate);
+	}
+
+	free(pen);
+	local->private = NULL;
+}
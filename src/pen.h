@@ -0,0 +1,44 @@
+/***************************************************************************
+ *
+ * Multitouch X driver
+ * Copyright (C) 2008 Henrik Rydberg <rydberg@euromail.se>
+ * Copyright (C) 2009,2010 Nokia Corporation
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ **************************************************************************/
+
+#ifndef PEN_H
+#define PEN_H
+
+#include "xorg-server.h"
+#include <xf86Xinput.h>
+
+#include "mtouch.h"
+
+/*
+ * Pen contacts are routed to a separate absolute device with x, y and
+ * pressure, created next to the touch device with Option "PenDevice".
+ */
+
+void pen_create(LocalDevicePtr parent);
+void pen_detach(LocalDevicePtr parent);
+void pen_post(struct mtev_mtouch *mt, bool down, int x, int y, int pressure);
+
+bool pen_is(LocalDevicePtr local);
+InputInfoPtr pen_preinit(LocalDevicePtr local, const char *parent_name);
+void pen_uninit(LocalDevicePtr local);
+
+#endif
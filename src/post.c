@@ -0,0 +1,267 @@
+/***************************************************************************
+ *
+ * Multitouch protocol X driver
+ * Copyright (C) 2008 Henrik Rydberg <rydberg@euromail.se>
+ * Copyright (C) 2009,2010 Nokia Corporation
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ **************************************************************************/
+
+#include <sys/time.h>
+#include <xf86.h>
+
+#include "post.h"
+
+/*
+ * Valuator layout: the per finger axes, then the frame valuators,
+ * which are the contact count, the gesture deltas and the frame time.
+ * Valuators 0 and 1 drive the core pointer, so finger 0's position
+ * comes first. Frame valuators make every event carry all fingers, so
+ * the contact count tells which of them are down.
+ */
+int post_first_frame_valuator(const struct mtev_mtouch *mt)
+{
+	return mt->num_fingers * mt->num_axes;
+}
+
+int post_num_frame_valuators(const struct mtev_mtouch *mt)
+{
+	const int num = (mt->gestures ? MT_NUM_GESTURE_VALUATORS : 0) +
+		(mt->timestamps ? 1 : 0);
+
+	return num ? num + 1 : 0;
+}
+
+int post_contact_count_valuator(const struct mtev_mtouch *mt)
+{
+	return post_first_frame_valuator(mt);
+}
+
+int post_gesture_valuator(const struct mtev_mtouch *mt)
+{
+	return post_contact_count_valuator(mt) + 1;
+}
+
+int post_frame_time_valuator(const struct mtev_mtouch *mt)
+{
+	return post_gesture_valuator(mt) +
+		(mt->gestures ? MT_NUM_GESTURE_VALUATORS : 0);
+}
+
+int post_num_valuators(const struct mtev_mtouch *mt)
+{
+	return post_first_frame_valuator(mt) + post_num_frame_valuators(mt);
+}
+
+/* Most fingers whose axes fit in the server's valuators */
+int post_max_fingers(const struct mtev_mtouch *mt)
+{
+	return (MAX_VALUATORS - post_num_frame_valuators(mt)) / mt->num_axes;
+}
+
+static int axis_value(const struct mtev_mtouch *mt,
+		      const struct mtev_touch_point *tp,
+		      enum mtev_axis axis, int x, int y)
+{
+	switch (axis) {
+	case MT_AXIS_POSITION_X:
+		return x;
+	case MT_AXIS_POSITION_Y:
+		return y;
+	case MT_AXIS_TOUCH_MAJOR:
+		return tp->touch_major;
+	case MT_AXIS_TOUCH_MINOR:
+		return mt->caps.has_touch_minor ?
+			tp->touch_minor : tp->touch_major;
+	case MT_AXIS_WIDTH_MAJOR:
+		return tp->width_major;
+	case MT_AXIS_WIDTH_MINOR:
+		return mt->caps.has_width_minor ?
+			tp->width_minor : tp->width_major;
+	case MT_AXIS_ORIENTATION:
+		return tp->orientation;
+	case MT_AXIS_PRESSURE:
+		return tp->pressure;
+	case MT_AXIS_TRACKING_ID:
+		return tp->tracking_id;
+	case MT_AXIS_VELOCITY_X:
+		return velocity_get(&mt->velocity, tp->tracking_id)->vx;
+	case MT_AXIS_VELOCITY_Y:
+		return velocity_get(&mt->velocity, tp->tracking_id)->vy;
+	case MT_AXIS_ACCELERATION_X:
+		return velocity_get(&mt->velocity, tp->tracking_id)->ax;
+	case MT_AXIS_ACCELERATION_Y:
+		return velocity_get(&mt->velocity, tp->tracking_id)->ay;
+	default:
+		return 0;
+	}
+}
+
+/* Kernel time of the current frame in server time, wrapped to 31 bits */
+static int frame_time(const struct mtev_mtouch *mt)
+{
+	const struct timeval *tv = mtouch_frame_time(mt);
+	struct timeval now;
+	CARD32 ms;
+
+	if (mt->monotonic_time) {
+		ms = (CARD32)tv->tv_sec * 1000 + tv->tv_usec / 1000;
+	} else {
+		// Realtime stamps, go back from server time by the frame age
+		gettimeofday(&now, NULL);
+		ms = GetTimeInMillis() -
+			((now.tv_sec - tv->tv_sec) * 1000 +
+			 (now.tv_usec - tv->tv_usec) / 1000);
+	}
+
+	return ms & 0x7fffffff;
+}
+
+/* Screen orientation and output mapping, shared by fingers and pen */
+static void transform_point(const struct mtev_mtouch *mt,
+			    const struct mtev_touch_point *tp,
+			    int *px, int *py)
+{
+	int x = tp->position_x;
+	int y = tp->position_y;
+
+	if (mt->cfg.swap_xy) {
+		const int tmp = y;
+		y = x;
+		x = tmp;
+	}
+
+	if (mt->cfg.invert_x)
+		x = (long long)mt->max_x - x + mt->min_x;
+
+	if (mt->cfg.invert_y)
+		y = (long long)mt->max_y - y + mt->min_y;
+
+	/* Squeeze into the output area of the screen */
+	if (mt->map_output) {
+		x = mt->min_x + mt->map_offset_x +
+			(((long long)x - mt->min_x) * mt->map_scale_x >> 16);
+		y = mt->min_y + mt->map_offset_y +
+			(((long long)y - mt->min_y) * mt->map_scale_y >> 16);
+	}
+
+	*px = x;
+	*py = y;
+}
+
+/*
+ * Fills the valuators and works out the button and pen state of the
+ * current frame. Fingers that are not down keep their last values,
+ * past the contact count when there is one.
+ */
+void post_frame(struct mtev_mtouch *mt, struct mtev_post *post)
+{
+	const struct mtev_touch_point *tp;
+	const struct mtev_touch_point *pen = NULL;
+	int *valuators = mt->valuators;
+	int finger_x[MT_NUM_FINGERS];
+	int finger_y[MT_NUM_FINGERS];
+	int finger_id[MT_NUM_FINGERS];
+	int down;
+	int valix;
+	int contacts;
+	int i;
+
+	contacts = down = 0;
+	valix = 0;
+
+	if (mt->velocity_axes)
+		velocity_begin_frame(&mt->velocity);
+
+	while ((tp = mtouch_get_contact(mt, contacts)) != NULL) {
+		contacts++;
+
+		if (mt->pen_routing && tp->tool_type == MT_TOOL_PEN) {
+			if (!pen)
+				pen = tp;
+			continue;
+		}
+
+		// We don't do remapping of tracking id's so
+		// make sure clients don't see too high tracking_id numbers
+		if (tp->tracking_id < MT_NUM_FINGERS) {
+			int x;
+			int y;
+
+			transform_point(mt, tp, &x, &y);
+
+			if (mt->velocity_axes)
+				velocity_update(&mt->velocity, tp->tracking_id,
+						x, y, mtouch_frame_time(mt));
+
+			/* Gestures still see the fingers past MaxContacts */
+			for (i = 0; down < mt->num_fingers &&
+				     i < mt->num_axes; i++)
+				valuators[valix++] = axis_value(mt, tp,
+								mt->axis[i],
+								x, y);
+
+			finger_x[down] = x;
+			finger_y[down] = y;
+			finger_id[down] = tp->tracking_id;
+			down++;
+		}
+
+		if (down >= MT_NUM_FINGERS)
+			break;
+	}
+
+	if (mt->velocity_axes)
+		velocity_end_frame(&mt->velocity);
+
+	post->clicks_x = 0;
+	post->clicks_y = 0;
+	if (mt->gestures) {
+		i = post_gesture_valuator(mt);
+		gesture_update(&mt->gesture, finger_x, finger_y, finger_id,
+			       down);
+		valuators[i] = mt->gesture.pan_x;
+		valuators[i + 1] = mt->gesture.pan_y;
+		valuators[i + 2] = mt->gesture.scale;
+		valuators[i + 3] = mt->gesture.rotation;
+		post->clicks_x = mt->gesture.clicks_x;
+		post->clicks_y = mt->gesture.clicks_y;
+	}
+
+	if (mt->timestamps)
+		valuators[post_frame_time_valuator(mt)] = frame_time(mt);
+
+	/* Fingers that are not down repeat their last values */
+	if (post_num_frame_valuators(mt)) {
+		valuators[post_contact_count_valuator(mt)] =
+			down < mt->num_fingers ? down : mt->num_fingers;
+		valix = post_num_valuators(mt);
+	}
+
+	post->num_valuators = valix;
+	post->down = down;
+	post->button = !!down - mt->button_down;
+	mt->button_down = !!down;
+
+	post->pen = pen != NULL;
+	post->pen_x = 0;
+	post->pen_y = 0;
+	post->pen_pressure = 0;
+	if (pen) {
+		transform_point(mt, pen, &post->pen_x, &post->pen_y);
+		post->pen_pressure = pen->pressure;
+	}
+}
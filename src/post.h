@@ -0,0 +1,58 @@
+/***************************************************************************
+ *
+ * Multitouch protocol X driver
+ * Copyright (C) 2008 Henrik Rydberg <rydberg@euromail.se>
+ * Copyright (C) 2009,2010 Nokia Corporation
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ **************************************************************************/
+
+#ifndef POST_H
+#define POST_H
+
+#include "mtouch.h"
+
+/*
+ * What process_state() posts for one frame, worked out without the
+ * server so that tests can compare it. The valuators themselves are
+ * left in mtev_mtouch.valuators.
+ */
+struct mtev_post {
+	int num_valuators;
+	int down;
+
+	/* Button 1 transition: 1 press, -1 release, 0 none */
+	int button;
+
+	/* Scroll clicks, negative is up/left */
+	int clicks_x, clicks_y;
+
+	bool pen;
+	int pen_x, pen_y;
+	int pen_pressure;
+};
+
+int post_first_frame_valuator(const struct mtev_mtouch *mt);
+int post_num_frame_valuators(const struct mtev_mtouch *mt);
+int post_contact_count_valuator(const struct mtev_mtouch *mt);
+int post_gesture_valuator(const struct mtev_mtouch *mt);
+int post_frame_time_valuator(const struct mtev_mtouch *mt);
+int post_num_valuators(const struct mtev_mtouch *mt);
+int post_max_fingers(const struct mtev_mtouch *mt);
+
+void post_frame(struct mtev_mtouch *mt, struct mtev_post *post);
+
+#endif
@@ -0,0 +1,42 @@
+/***************************************************************************
+ *
+ * Multitouch protocol X driver
+ * Copyright (C) 2008 Henrik Rydberg <rydberg@euromail.se>
+ * Copyright (C) 2009,2010 Nokia Corporation
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ **************************************************************************/
+
+#ifndef PROBES_H
+#define PROBES_H
+
+/*
+ * Static tracepoints for perf/bpftrace, e.g.
+ *   bpftrace -e 'usdt:/usr/lib/xorg/modules/input/mtev.so:mtev:frame
+ *                { printf("%d contacts\n", arg0); }'
+ * A probe is a single nop when no tracer is attached.
+ */
+
+#ifdef HAVE_SYS_SDT_H
+#include <sys/sdt.h>
+#define PROBE2(name, a, b)	DTRACE_PROBE2(mtev, name, a, b)
+#define PROBE3(name, a, b, c)	DTRACE_PROBE3(mtev, name, a, b, c)
+#else
+#define PROBE2(name, a, b)	do { } while (0)
+#define PROBE3(name, a, b, c)	do { } while (0)
+#endif
+
+#endif
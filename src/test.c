@@ -0,0 +1,998 @@
+/***************************************************************************
+ *
+ * Multitouch protocol X driver
+ * Copyright (C) 2008 Henrik Rydberg <rydberg@euromail.se>
+ * Copyright (C) 2009,2010 Nokia Corporation
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ **************************************************************************/
+
+/*
+ * Differential test of the input path. Every event stream goes through
+ * two devices, one reading it with mtouch_read_synchronized_event() and
+ * one parsing it with reference_read() below, and what post_frame()
+ * gives for each frame must be the same for both.
+ *
+ * usage: test [-b] [-n frames] [-s seed] [file...]
+ *
+ * Without -s a fixed set of seeds is run. Each generated stream prints
+ * its seed, -s reruns just that one. Files hold recorded streams, see
+ * test/README. -b times hw_read() against reference_read() instead.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <xf86.h>
+
+#include "mtouch.h"
+#include "post.h"
+
+/* The driver only needs these two from the server */
+void xf86Msg(MessageType type, const char *format, ...)
+{
+	va_list args;
+
+	if (type != X_ERROR)
+		return;
+
+	va_start(args, format);
+	vfprintf(stderr, format, args);
+	va_end(args);
+}
+
+CARD32 GetTimeInMillis(void)
+{
+	return 0;
+}
+
+#define DEFAULT_FRAMES 5000
+#define MAX_STREAM     (1 << 20)
+#define MAX_CHUNK      (16 * sizeof(struct input_event))
+
+static const unsigned int default_seeds[] = {
+	1, 2, 3, 42, 1000, 31337, 65535, 0xdeadbeef
+};
+
+struct test_setup {
+	const char *name;
+	const char *axes;
+	int num_fingers;
+	bool gestures;
+	bool timestamps;
+	bool pen_routing;
+	bool no_tracking_id;
+	struct mtev_config cfg;
+};
+
+static const struct test_setup setups[] = {
+	{
+		.name = "default",
+		.axes = "x y touch_major touch_minor tracking_id",
+		.num_fingers = MT_NUM_FINGERS,
+		.cfg = {
+			.scroll_distance = 100,
+			.output_width = MT_OUTPUT_FULL,
+			.output_height = MT_OUTPUT_FULL,
+		},
+	},
+	{
+		.name = "all",
+		.axes = "x y touch_major touch_minor width_major width_minor "
+			"orientation pressure tracking_id velocity_x "
+			"velocity_y acceleration_x acceleration_y",
+		.num_fingers = MT_NUM_FINGERS,
+		.gestures = 1,
+		.timestamps = 1,
+		.pen_routing = 1,
+		.cfg = {
+			.scroll_distance = 50,
+			.output_width = MT_OUTPUT_FULL,
+			.output_height = MT_OUTPUT_FULL,
+		},
+	},
+	{
+		.name = "filtered",
+		.axes = "x y pressure tracking_id",
+		.num_fingers = MT_NUM_FINGERS,
+		.cfg = {
+			.swap_xy = 1,
+			.invert_x = 1,
+			.invert_y = 1,
+			.scroll_distance = 100,
+			.palm_touch_major = 50,
+			.palm_width_major = 50,
+			.touch_lifetime = 2,
+			.touch_grace = 2,
+			.output_x = MT_OUTPUT_FULL / 4,
+			.output_y = MT_OUTPUT_FULL / 3,
+			.output_width = MT_OUTPUT_FULL / 2,
+			.output_height = MT_OUTPUT_FULL / 3,
+		},
+	},
+	{
+		.name = "compact",
+		.axes = "x y",
+		.num_fingers = 1,
+		.gestures = 1,
+		.timestamps = 1,
+		.cfg = {
+			.scroll_distance = 20,
+			.touch_lifetime = 30,
+			.touch_grace = 30,
+			.touch_time_ms = 1,
+			.output_width = MT_OUTPUT_FULL,
+			.output_height = MT_OUTPUT_FULL,
+		},
+	},
+	{
+		.name = "no ids",
+		.axes = "x y pressure",
+		.num_fingers = MT_NUM_FINGERS,
+		.no_tracking_id = 1,
+		.cfg = {
+			.scroll_distance = 100,
+			.touch_lifetime = 2,
+			.touch_grace = 2,
+			.output_width = MT_OUTPUT_FULL,
+			.output_height = MT_OUTPUT_FULL,
+		},
+	},
+};
+
+#define NUM_SETUPS (sizeof(setups) / sizeof(setups[0]))
+
+static const char* const axis_names[MT_AXIS_COUNT] = {
+	"x", "y", "touch_major", "touch_minor", "width_major",
+	"width_minor", "orientation", "pressure", "tracking_id",
+	"velocity_x", "velocity_y", "acceleration_x", "acceleration_y",
+};
+
+/*
+ * One device under test, fed through a pipe like an evdev node. The
+ * reference device is handed the bytes directly and keeps a partial
+ * event in buf.
+ */
+struct test_device {
+	struct mtev_mtouch mt;
+	int fd[2];
+	bool reference;
+	struct input_event buf;
+	size_t buf_len;
+};
+
+/* What one frame posted */
+struct test_record {
+	struct mtev_post post;
+	int valuators[MT_MAX_VALUATORS];
+};
+
+#define MAX_RECORDS (MAX_CHUNK / sizeof(struct input_event) + 2)
+
+static struct test_device devices[2];
+static struct input_event stream[MAX_STREAM];
+
+static unsigned int next_random(unsigned int *seed)
+{
+	*seed = *seed * 1103515245 + 12345;
+	return *seed >> 8;
+}
+
+/*
+ * Frozen copy of hw_read(), which may be specialised as long as it
+ * gives the same frames.
+ */
+static bool reference_read(struct mtev_hw_state *hw,
+			   const struct input_event *ev)
+{
+	if (hw->dropped) {
+		if (ev->type == EV_SYN && ev->code == SYN_REPORT)
+			hw->dropped = 0;
+		return 0;
+	}
+
+	switch (ev->type) {
+	case EV_SYN:
+		switch (ev->code) {
+		case SYN_REPORT:
+			hw->num_contacts = hw->num_read;
+			hw->num_read = 0;
+			hw->reading = 0;
+			hw->time = ev->time;
+			return 1;
+		case SYN_DROPPED:
+			hw->num_read = 0;
+			hw->reading = 0;
+			hw->dropped = 1;
+			break;
+		case SYN_MT_REPORT:
+			if (!hw->reading) {
+				hw->reading = 1;
+				hw->contact[0].tool_type = MT_TOOL_FINGER;
+			}
+			if (hw->num_read < HW_MAX_CONTACTS) {
+				hw->num_read++;
+			}
+			if (hw->num_read < HW_MAX_CONTACTS) {
+				hw->contact[hw->num_read].tool_type =
+					MT_TOOL_FINGER;
+			}
+			break;
+		}
+		break;
+	case EV_ABS:
+		if (hw->num_read == HW_MAX_CONTACTS)
+			break;
+		if (ev->code >= ABS_MT_TOUCH_MAJOR &&
+		    ev->code <= ABS_MT_PRESSURE && !hw->reading) {
+			hw->reading = 1;
+			hw->contact[0].tool_type = MT_TOOL_FINGER;
+		}
+		switch (ev->code) {
+		case ABS_MT_POSITION_X:
+			hw->contact[hw->num_read].position_x = ev->value;
+			break;
+		case ABS_MT_POSITION_Y:
+			hw->contact[hw->num_read].position_y = ev->value;
+			break;
+		case ABS_MT_TOUCH_MAJOR:
+			hw->contact[hw->num_read].touch_major = ev->value;
+			break;
+		case ABS_MT_TOUCH_MINOR:
+			hw->contact[hw->num_read].touch_minor = ev->value;
+			break;
+		case ABS_MT_WIDTH_MAJOR:
+			hw->contact[hw->num_read].width_major = ev->value;
+			break;
+		case ABS_MT_WIDTH_MINOR:
+			hw->contact[hw->num_read].width_minor = ev->value;
+			break;
+		case ABS_MT_ORIENTATION:
+			hw->contact[hw->num_read].orientation = ev->value;
+			break;
+		case ABS_MT_PRESSURE:
+			hw->contact[hw->num_read].pressure = ev->value;
+			break;
+		case ABS_MT_TRACKING_ID:
+			hw->contact[hw->num_read].tracking_id = ev->value;
+			break;
+		case ABS_MT_TOOL_TYPE:
+			hw->contact[hw->num_read].tool_type = ev->value;
+			break;
+		}
+	}
+
+	return 0;
+}
+
+static void set_abs(struct input_absinfo *abs, int minimum, int maximum)
+{
+	abs->minimum = minimum;
+	abs->maximum = maximum;
+}
+
+static void init_caps(struct mtev_caps *caps)
+{
+	memset(caps, 0, sizeof(struct mtev_caps));
+	caps->has_mtdata = 1;
+	caps->has_touch_major = 1;
+	caps->has_touch_minor = 1;
+	caps->has_width_major = 1;
+	caps->has_width_minor = 1;
+	caps->has_orientation = 1;
+	caps->has_tracking_id = 1;
+	caps->has_pressure = 1;
+	caps->has_position_x = 1;
+	caps->has_position_y = 1;
+	set_abs(&caps->abs_touch_major, 0, 255);
+	set_abs(&caps->abs_touch_minor, 0, 255);
+	set_abs(&caps->abs_width_major, 0, 255);
+	set_abs(&caps->abs_width_minor, 0, 255);
+	set_abs(&caps->abs_orientation, -31, 32);
+	set_abs(&caps->abs_position_x, 0, 4095);
+	set_abs(&caps->abs_position_y, 0, 2047);
+	set_abs(&caps->abs_tracking_id, 0, 65535);
+	set_abs(&caps->abs_pressure, 0, 255);
+}
+
+static void parse_axes(struct mtev_mtouch *mt, const char *axes)
+{
+	char buf[256];
+	char *name;
+	char *save;
+	int i;
+
+	strncpy(buf, axes, sizeof(buf) - 1);
+	buf[sizeof(buf) - 1] = 0;
+
+	mt->num_axes = 0;
+	for (name = strtok_r(buf, " ", &save); name;
+	     name = strtok_r(NULL, " ", &save)) {
+		for (i = 0; i < MT_AXIS_COUNT; i++)
+			if (!strcmp(name, axis_names[i]))
+				break;
+		mt->axis[mt->num_axes++] = i;
+		if (i >= MT_AXIS_VELOCITY_X && i <= MT_AXIS_ACCELERATION_Y)
+			mt->velocity_axes = 1;
+	}
+}
+
+/* Same steps as preinit() and device_on(), without the ioctls */
+static int open_device(struct test_device *dev,
+		       const struct test_setup *setup, bool reference)
+{
+	struct mtev_mtouch *mt = &dev->mt;
+
+	memset(mt, 0, sizeof(struct mtev_mtouch));
+	if (pipe(dev->fd) < 0 ||
+	    fcntl(dev->fd[0], F_SETFL, O_NONBLOCK) < 0) {
+		perror("pipe");
+		return -1;
+	}
+
+	mt->num_nodes = 1;
+	mt->node[0].fd = dev->fd[0];
+	init_caps(&mt->node[0].caps);
+	mt->node[0].caps.has_tracking_id = !setup->no_tracking_id;
+	mt->node[0].caps_valid = 1;
+	mt->caps = mt->node[0].caps;
+
+	parse_axes(mt, setup->axes);
+	mt->num_fingers = setup->num_fingers;
+	mt->gestures = setup->gestures;
+	mt->timestamps = setup->timestamps;
+	mt->pen_routing = setup->pen_routing;
+	if (mt->num_fingers > post_max_fingers(mt))
+		mt->num_fingers = post_max_fingers(mt);
+	if (post_num_valuators(mt) > MAX_VALUATORS) {
+		fprintf(stderr, "%s: %d valuators\n", setup->name,
+			post_num_valuators(mt));
+		return -1;
+	}
+	dev->reference = reference;
+	dev->buf_len = 0;
+
+	palm_init(&mt->palm);
+	debounce_init(&mt->debounce);
+	gesture_init(&mt->gesture, setup->cfg.scroll_distance);
+
+	mtouch_open(mt);
+
+	// Kernel times are taken as they are, see frame_time()
+	mt->monotonic_time = 1;
+
+	// Picked up by the first frame, which also sets the ranges
+	mtouch_set_config(mt, &setup->cfg);
+	return 0;
+}
+
+static void close_device(struct test_device *dev)
+{
+	mtouch_close(&dev->mt);
+	close(dev->fd[0]);
+	close(dev->fd[1]);
+}
+
+static void record_frame(struct mtev_mtouch *mt, struct test_record *rec)
+{
+	memset(rec, 0, sizeof(struct test_record));
+	post_frame(mt, &rec->post);
+	memcpy(rec->valuators, mt->valuators,
+	       rec->post.num_valuators * sizeof(int));
+}
+
+/* What the read loop does, with reference_read() as the parser */
+static int feed_reference(struct test_device *dev, const char *data,
+			  size_t size, struct test_record *rec)
+{
+	struct mtev_mtouch *mt = &dev->mt;
+	struct mtev_node *node = &mt->node[0];
+	char *buf = (char *)&dev->buf;
+	int n = 0;
+
+	while (size) {
+		size_t len = sizeof(struct input_event) - dev->buf_len;
+
+		if (len > size)
+			len = size;
+		memcpy(buf + dev->buf_len, data, len);
+		dev->buf_len += len;
+		data += len;
+		size -= len;
+
+		if (dev->buf_len < sizeof(struct input_event))
+			break;
+		dev->buf_len = 0;
+
+		if (reference_read(&node->hw_state, &dev->buf)) {
+			mtouch_complete_frame(mt, node);
+			record_frame(mt, &rec[n++]);
+		}
+	}
+
+	return n;
+}
+
+/* Feeds one chunk and collects the frames it completes */
+static int feed(struct test_device *dev, const void *data, size_t size,
+		bool expire, struct test_record *rec)
+{
+	struct mtev_mtouch *mt = &dev->mt;
+	int n = 0;
+
+	if (dev->reference) {
+		n = feed_reference(dev, data, size, rec);
+	} else {
+		if (size && write(dev->fd[1], data, size) != (ssize_t)size) {
+			perror("write");
+			exit(2);
+		}
+		while (mtouch_read_synchronized_event(mt, dev->fd[0]))
+			record_frame(mt, &rec[n++]);
+	}
+
+	// What the debounce timer does when frames stop
+	if (expire && mtouch_expire_timeout(mt) &&
+	    mtouch_expire_contacts(mt))
+		record_frame(mt, &rec[n++]);
+
+	return n;
+}
+
+static void print_record(const char *label, const struct test_record *rec)
+{
+	const struct mtev_post *post = &rec->post;
+	int i;
+
+	printf("  %s: down %d button %d clicks %d %d pen %d %d %d %d\n"
+	       "    valuators", label, post->down, post->button,
+	       post->clicks_x, post->clicks_y, post->pen,
+	       post->pen_x, post->pen_y, post->pen_pressure);
+	for (i = 0; i < post->num_valuators; i++)
+		printf(" %d", rec->valuators[i]);
+	printf("\n");
+}
+
+static bool same_record(const struct test_record *a,
+			const struct test_record *b)
+{
+	return !memcmp(&a->post, &b->post, sizeof(struct mtev_post)) &&
+		!memcmp(a->valuators, b->valuators,
+			a->post.num_valuators * sizeof(int));
+}
+
+/*
+ * Runs a stream through both devices in chunks of random size, so that
+ * events also get split across reads. Returns the frames compared or
+ * -1 on the first difference.
+ */
+static long run_stream(const char *name, const struct test_setup *setup,
+		       const struct input_event *ev, int num_events,
+		       unsigned int seed)
+{
+	const char *data = (const char *)ev;
+	const size_t size = num_events * sizeof(struct input_event);
+	struct test_record rec[2][MAX_RECORDS];
+	size_t pos = 0;
+	long frames = 0;
+	int i;
+
+	if (open_device(&devices[0], setup, 0) ||
+	    open_device(&devices[1], setup, 1))
+		exit(2);
+
+	while (pos < size) {
+		size_t chunk = 1 + next_random(&seed) % MAX_CHUNK;
+		const bool expire = next_random(&seed) % 4 == 0;
+		int n[2];
+
+		if (chunk > size - pos)
+			chunk = size - pos;
+
+		n[0] = feed(&devices[0], data + pos, chunk, expire, rec[0]);
+		n[1] = feed(&devices[1], data + pos, chunk, expire, rec[1]);
+		pos += chunk;
+
+		for (i = 0; i < n[0] || i < n[1]; i++, frames++) {
+			if (i < n[0] && i < n[1] &&
+			    same_record(&rec[0][i], &rec[1][i]))
+				continue;
+
+			printf("%s, setup %s: frame %ld differs\n",
+			       name, setup->name, frames);
+			if (i < n[0])
+				print_record("hw_read", &rec[0][i]);
+			if (i < n[1])
+				print_record("reference", &rec[1][i]);
+			frames = -1;
+			goto out;
+		}
+	}
+
+out:
+	close_device(&devices[0]);
+	close_device(&devices[1]);
+	return frames;
+}
+
+static void add_event(struct input_event *ev, int *n,
+		      const struct timeval *time, int type, int code, int value)
+{
+	if (*n == MAX_STREAM)
+		return;
+
+	ev[*n].time = *time;
+	ev[*n].type = type;
+	ev[*n].code = code;
+	ev[*n].value = value;
+	(*n)++;
+}
+
+static void advance(struct timeval *time, int usec)
+{
+	time->tv_usec += usec;
+	time->tv_sec += time->tv_usec / 1000000;
+	time->tv_usec %= 1000000;
+}
+
+/* Mostly sane values, sometimes negative, huge or out of range */
+static int random_value(unsigned int *seed)
+{
+	switch (next_random(seed) % 8) {
+	case 0:
+		return -(int)(next_random(seed) % 1000);
+	case 1:
+		return next_random(seed) << 8;
+	case 2:
+		return next_random(seed) % 16;
+	default:
+		return next_random(seed) % 4096;
+	}
+}
+
+/* Events in any order, stray SYN and KEY events included */
+static void random_frame(struct input_event *ev, int *n,
+			 const struct timeval *time, unsigned int *seed)
+{
+	const int events = next_random(seed) % (HW_MAX_CONTACTS * 2 * 8);
+	int i;
+
+	for (i = 0; i < events; i++) {
+		const unsigned int r = next_random(seed) % 32;
+		const int value = random_value(seed);
+
+		if (r < 22)
+			add_event(ev, n, time, EV_ABS, ABS_MT_TOUCH_MAJOR - 2 +
+				  next_random(seed) % 15, value);
+		else if (r < 29)
+			add_event(ev, n, time, EV_SYN, SYN_MT_REPORT, 0);
+		else if (r < 30)
+			add_event(ev, n, time, EV_SYN,
+				  next_random(seed) % 4, value);
+		else
+			add_event(ev, n, time, EV_KEY, BTN_TOUCH, value & 1);
+	}
+}
+
+/* A tracked contact of the generated streams */
+struct test_contact {
+	int id;
+	int x, y;
+	int dx, dy;
+	int major;
+	int tool;
+};
+
+/*
+ * Well formed frames of moving contacts, now and then past
+ * HW_MAX_CONTACTS, with odd tracking ids, pens, left out fields or
+ * contacts in another order.
+ */
+static void contact_frame(struct input_event *ev, int *n,
+			  const struct timeval *time, unsigned int *seed,
+			  struct test_contact *c, int *num)
+{
+	int i;
+
+	if (next_random(seed) % 8 == 0 && *num < HW_MAX_CONTACTS + 4) {
+		struct test_contact *nc = &c[(*num)++];
+
+		switch (next_random(seed) % 8) {
+		case 0:
+			nc->id = -1 - next_random(seed) % 4;
+			break;
+		case 1:
+			nc->id = next_random(seed) << 8;
+			break;
+		case 2:
+			nc->id = *num > 1 ? c[0].id : 0;
+			break;
+		default:
+			nc->id = next_random(seed) % 16;
+			break;
+		}
+		nc->x = next_random(seed) % 4096;
+		nc->y = next_random(seed) % 2048;
+		nc->dx = (int)(next_random(seed) % 61) - 30;
+		nc->dy = (int)(next_random(seed) % 61) - 30;
+		nc->major = next_random(seed) % 256;
+		nc->tool = next_random(seed) % 6 == 0 ?
+			MT_TOOL_PEN : MT_TOOL_FINGER;
+	}
+
+	if (*num && next_random(seed) % 12 == 0) {
+		i = next_random(seed) % *num;
+		c[i] = c[--(*num)];
+	}
+
+	if (*num > 1 && next_random(seed) % 6 == 0) {
+		const struct test_contact tmp = c[0];
+		c[0] = c[*num - 1];
+		c[*num - 1] = tmp;
+	}
+
+	for (i = 0; i < *num; i++) {
+		c[i].x += c[i].dx;
+		c[i].y += c[i].dy;
+
+		add_event(ev, n, time, EV_ABS, ABS_MT_TRACKING_ID, c[i].id);
+		add_event(ev, n, time, EV_ABS, ABS_MT_POSITION_X, c[i].x);
+		add_event(ev, n, time, EV_ABS, ABS_MT_POSITION_Y, c[i].y);
+		if (next_random(seed) % 4)
+			add_event(ev, n, time, EV_ABS,
+				  ABS_MT_TOUCH_MAJOR, c[i].major);
+		add_event(ev, n, time, EV_ABS, ABS_MT_WIDTH_MAJOR,
+			  c[i].major + 10);
+		add_event(ev, n, time, EV_ABS, ABS_MT_PRESSURE, c[i].major);
+		if (c[i].tool != MT_TOOL_FINGER)
+			add_event(ev, n, time, EV_ABS,
+				  ABS_MT_TOOL_TYPE, c[i].tool);
+		add_event(ev, n, time, EV_SYN, SYN_MT_REPORT, 0);
+	}
+}
+
+static int generate(struct input_event *ev, unsigned int seed, int frames)
+{
+	struct test_contact c[HW_MAX_CONTACTS + 4];
+	struct timeval time = { 1000, 0 };
+	int num = 0;
+	int n = 0;
+	int i;
+
+	for (i = 0; i < frames; i++) {
+		if (next_random(&seed) % 4 == 0)
+			random_frame(ev, &n, &time, &seed);
+		else
+			contact_frame(ev, &n, &time, &seed, c, &num);
+
+		add_event(ev, &n, &time, EV_SYN, SYN_REPORT, 0);
+		advance(&time, 4000 + next_random(&seed) % 20000);
+	}
+
+	return n;
+}
+
+/* Names that may appear in recorded streams */
+static const struct {
+	const char *name;
+	int type;
+	int code;
+} event_names[] = {
+	{ "SYN_REPORT", EV_SYN, SYN_REPORT },
+	{ "SYN_MT_REPORT", EV_SYN, SYN_MT_REPORT },
+	{ "SYN_DROPPED", EV_SYN, SYN_DROPPED },
+	{ "BTN_TOUCH", EV_KEY, BTN_TOUCH },
+	{ "ABS_MT_TOUCH_MAJOR", EV_ABS, ABS_MT_TOUCH_MAJOR },
+	{ "ABS_MT_TOUCH_MINOR", EV_ABS, ABS_MT_TOUCH_MINOR },
+	{ "ABS_MT_WIDTH_MAJOR", EV_ABS, ABS_MT_WIDTH_MAJOR },
+	{ "ABS_MT_WIDTH_MINOR", EV_ABS, ABS_MT_WIDTH_MINOR },
+	{ "ABS_MT_ORIENTATION", EV_ABS, ABS_MT_ORIENTATION },
+	{ "ABS_MT_POSITION_X", EV_ABS, ABS_MT_POSITION_X },
+	{ "ABS_MT_POSITION_Y", EV_ABS, ABS_MT_POSITION_Y },
+	{ "ABS_MT_TOOL_TYPE", EV_ABS, ABS_MT_TOOL_TYPE },
+	{ "ABS_MT_BLOB_ID", EV_ABS, ABS_MT_BLOB_ID },
+	{ "ABS_MT_TRACKING_ID", EV_ABS, ABS_MT_TRACKING_ID },
+	{ "ABS_MT_PRESSURE", EV_ABS, ABS_MT_PRESSURE },
+};
+
+#define NUM_EVENT_NAMES (sizeof(event_names) / sizeof(event_names[0]))
+
+/*
+ * Reads a recorded stream, one event per line, see test/README.
+ * Returns the number of events or -1.
+ */
+static int load(struct input_event *ev, const char *path)
+{
+	struct timeval time = { 1000, 0 };
+	char line[256];
+	FILE *f;
+	int n = 0;
+	int lineno = 0;
+	int i;
+
+	f = fopen(path, "r");
+	if (!f) {
+		fprintf(stderr, "%s: %s\n", path, strerror(errno));
+		return -1;
+	}
+
+	while (fgets(line, sizeof(line), f)) {
+		char name[64];
+		int type;
+		int code;
+		int value = 0;
+		int fields;
+
+		lineno++;
+		fields = sscanf(line, "%63s %d %d %d", name, &type, &code,
+				&value);
+		if (fields < 1 || name[0] == '#')
+			continue;
+
+		if (!strcmp(name, "DELAY") && fields >= 2) {
+			advance(&time, type * 1000);
+			continue;
+		}
+		if (!strcmp(name, "EV") && fields == 4) {
+			add_event(ev, &n, &time, type, code, value);
+			continue;
+		}
+
+		for (i = 0; i < NUM_EVENT_NAMES; i++)
+			if (!strcmp(name, event_names[i].name))
+				break;
+		if (i == NUM_EVENT_NAMES || fields > 2) {
+			fprintf(stderr, "%s:%d: cannot parse\n", path, lineno);
+			fclose(f);
+			return -1;
+		}
+
+		add_event(ev, &n, &time, event_names[i].type,
+			  event_names[i].code, fields == 2 ? type : 0);
+		if (event_names[i].code == SYN_REPORT &&
+		    event_names[i].type == EV_SYN)
+			advance(&time, 10000);
+	}
+
+	fclose(f);
+	return n;
+}
+
+static bool run_all(const char *name, int num_events, unsigned int seed)
+{
+	bool ok = 1;
+	int i;
+
+	for (i = 0; i < NUM_SETUPS; i++) {
+		const long frames = run_stream(name, &setups[i], stream,
+					       num_events, seed);
+
+		if (frames < 0) {
+			ok = 0;
+			continue;
+		}
+		printf("%s, setup %s: %ld frames agree\n",
+		       name, setups[i].name, frames);
+	}
+
+	return ok;
+}
+
+/* The setup of that name, which must exist */
+static const struct test_setup* find_setup(const char *name)
+{
+	int i;
+
+	for (i = 0; i < NUM_SETUPS; i++)
+		if (!strcmp(setups[i].name, name))
+			break;
+
+	return &setups[i];
+}
+
+/* Contacts 0..num-1 side by side, with or without tracking ids */
+static void touch_frame(struct input_event *ev, int *n,
+			struct timeval *time, int num, bool ids)
+{
+	int i;
+
+	for (i = 0; i < num; i++) {
+		if (ids)
+			add_event(ev, n, time, EV_ABS, ABS_MT_TRACKING_ID, i);
+		add_event(ev, n, time, EV_ABS, ABS_MT_POSITION_X,
+			  500 + 1000 * i);
+		add_event(ev, n, time, EV_ABS, ABS_MT_POSITION_Y, 1000);
+		add_event(ev, n, time, EV_ABS, ABS_MT_PRESSURE, 100);
+		add_event(ev, n, time, EV_SYN, SYN_MT_REPORT, 0);
+	}
+	add_event(ev, n, time, EV_SYN, SYN_REPORT, 0);
+	advance(time, 10000);
+}
+
+/*
+ * Runs frames of the given contact counts through one device. Returns
+ * the number of frames posted, at most num.
+ */
+static int touch_frames(const char *setup, const int *contacts, int num,
+			bool ids, struct test_record *rec)
+{
+	struct timeval time = { 1000, 0 };
+	int posted = 0;
+	int i;
+
+	if (open_device(&devices[0], find_setup(setup), 0))
+		exit(2);
+
+	for (i = 0; i < num; i++) {
+		int n = 0;
+
+		touch_frame(stream, &n, &time, contacts[i], ids);
+		posted += feed(&devices[0], stream,
+			       n * sizeof(struct input_event), 0,
+			       rec + posted);
+	}
+
+	close_device(&devices[0]);
+	return posted;
+}
+
+static bool report(const char *name, bool ok)
+{
+	printf("check %s: %s\n", name, ok ? "ok" : "FAILED");
+	return ok;
+}
+
+/* The lifetime filter needs tracking ids, without them it is off */
+static bool check_no_ids(void)
+{
+	static const int contacts[] = { 1 };
+	struct test_record rec[MAX_RECORDS];
+	const int n = touch_frames("no ids", contacts, 1, 0, rec);
+
+	return report("no ids", n == 1 && rec[0].post.down == 1);
+}
+
+/*
+ * With frame valuators every finger is posted, and a lift must show in
+ * the contact count, down to 0 on the release.
+ */
+static bool check_lift(void)
+{
+	static const int contacts[] = { 2, 1, 0 };
+	const struct mtev_mtouch *mt = &devices[0].mt;
+	struct test_record rec[MAX_RECORDS];
+	const int n = touch_frames("all", contacts, 3, 1, rec);
+	const int count = post_contact_count_valuator(mt);
+	bool ok = n == 3;
+	int i;
+
+	for (i = 0; ok && i < n; i++)
+		ok = rec[i].post.num_valuators == post_num_valuators(mt) &&
+			rec[i].valuators[count] == contacts[i];
+
+	return report("lift", ok && rec[2].post.button == -1);
+}
+
+static double elapsed_ns(const struct timespec *a, const struct timespec *b)
+{
+	return (b->tv_sec - a->tv_sec) * 1e9 + (b->tv_nsec - a->tv_nsec);
+}
+
+/* Parser cost per event, the best of a few rounds */
+static void bench(unsigned int seed, int frames)
+{
+	const int num_events = generate(stream, seed, frames);
+	struct mtev_hw_state hw;
+	struct timespec t0, t1;
+	double best[2] = { 0, 0 };
+	int round;
+	int p;
+	int i;
+
+	for (round = 0; round < 5; round++) {
+		for (p = 0; p < 2; p++) {
+			hw_init(&hw);
+			clock_gettime(CLOCK_MONOTONIC, &t0);
+			for (i = 0; i < num_events; i++)
+				if (p)
+					reference_read(&hw, &stream[i]);
+				else
+					hw_read(&hw, &stream[i]);
+			clock_gettime(CLOCK_MONOTONIC, &t1);
+
+			if (!round || elapsed_ns(&t0, &t1) < best[p])
+				best[p] = elapsed_ns(&t0, &t1);
+		}
+	}
+
+	printf("seed %u, %d events: hw_read %.2f ns/event, "
+	       "reference_read %.2f ns/event\n", seed, num_events,
+	       best[0] / num_events, best[1] / num_events);
+}
+
+int main(int argc, char *argv[])
+{
+	unsigned int seed = 0;
+	bool have_seed = 0;
+	bool timing = 0;
+	int frames = DEFAULT_FRAMES;
+	bool ok = 1;
+	char name[64];
+	int opt;
+	int i;
+
+	while ((opt = getopt(argc, argv, "bn:s:")) != -1) {
+		switch (opt) {
+		case 'b':
+			timing = 1;
+			break;
+		case 'n':
+			frames = atoi(optarg);
+			break;
+		case 's':
+			seed = strtoul(optarg, NULL, 0);
+			have_seed = 1;
+			break;
+		default:
+			fprintf(stderr, "usage: %s [-b] [-n frames] "
+				"[-s seed] [file...]\n", argv[0]);
+			return 2;
+		}
+	}
+
+	// Longest generated frame, see random_frame()
+	if (frames < 1 || frames > MAX_STREAM / (HW_MAX_CONTACTS * 2 * 8 + 1))
+		frames = DEFAULT_FRAMES;
+
+	if (timing) {
+		bench(have_seed ? seed : default_seeds[0], frames);
+		return 0;
+	}
+
+	for (i = 0; i < (have_seed ? 1 : sizeof(default_seeds) /
+			 sizeof(default_seeds[0])); i++) {
+		if (!have_seed)
+			seed = default_seeds[i];
+		snprintf(name, sizeof(name), "seed %u", seed);
+		if (!run_all(name, generate(stream, seed, frames), seed))
+			ok = 0;
+	}
+
+	for (i = optind; i < argc; i++) {
+		const int num_events = load(stream, argv[i]);
+
+		if (num_events < 0) {
+			ok = 0;
+			continue;
+		}
+		if (!run_all(argv[i], num_events, 1))
+			ok = 0;
+	}
+
+	if (!check_no_ids())
+		ok = 0;
+	if (!check_lift())
+		ok = 0;
+
+	if (!ok)
+		printf("FAILED, rerun a generated stream with -s <seed>\n");
+	return ok ? 0 : 1;
+}
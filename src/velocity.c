@@ -0,0 +1,114 @@
+/***************************************************************************
+ *
+ * Multitouch protocol X driver
+ * Copyright (C) 2008 Henrik Rydberg <rydberg@euromail.se>
+ * Copyright (C) 2009,2010 Nokia Corporation
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ **************************************************************************/
+
+#include <string.h>
+
+#include "velocity.h"
+
+void velocity_init(struct mtev_velocity *v)
+{
+	memset(v, 0, sizeof(struct mtev_velocity));
+}
+
+void velocity_begin_frame(struct mtev_velocity *v)
+{
+	int i;
+
+	for (i = 0; i < HW_MAX_CONTACTS; i++)
+		v->slot[i].seen = 0;
+}
+
+static int clamp(long long value, int max)
+{
+	if (value > max)
+		return max;
+	if (value < -max)
+		return -max;
+	return value;
+}
+
+/* Change per second over dt microseconds */
+static int rate(long long delta, long long dt, int max)
+{
+	return clamp(delta * 1000000LL / dt, max);
+}
+
+void velocity_update(struct mtev_velocity *v, int tracking_id,
+		     int x, int y, const struct timeval *time)
+{
+	struct mtev_velocity_slot *s;
+	long long dt;
+	int vx;
+	int vy;
+
+	if (tracking_id < 0 || tracking_id >= HW_MAX_CONTACTS)
+		return;
+
+	s = &v->slot[tracking_id];
+	s->seen = 1;
+
+	if (!s->valid) {
+		s->valid = 1;
+		s->vx = s->vy = 0;
+		s->ax = s->ay = 0;
+	} else {
+		dt = (time->tv_sec - s->time.tv_sec) * 1000000LL +
+			(time->tv_usec - s->time.tv_usec);
+
+		// Same or bogus timestamp, keep the previous estimate
+		if (dt <= 0)
+			return;
+
+		vx = rate((long long)x - s->x, dt, VELOCITY_MAX);
+		vy = rate((long long)y - s->y, dt, VELOCITY_MAX);
+		s->ax = rate(vx - s->vx, dt, ACCELERATION_MAX);
+		s->ay = rate(vy - s->vy, dt, ACCELERATION_MAX);
+		s->vx = vx;
+		s->vy = vy;
+	}
+
+	s->x = x;
+	s->y = y;
+	s->time = *time;
+}
+
+/* Contacts not seen in this frame have lifted, start over next time */
+void velocity_end_frame(struct mtev_velocity *v)
+{
+	int i;
+
+	for (i = 0; i < HW_MAX_CONTACTS; i++)
+		if (!v->slot[i].seen)
+			v->slot[i].valid = 0;
+}
+
+/* Out of range ids read as not moving */
+const struct mtev_velocity_slot* velocity_get(const struct mtev_velocity *v,
+					      int tracking_id)
+{
+	static const struct mtev_velocity_slot still;
+
+	if (tracking_id < 0 || tracking_id >= HW_MAX_CONTACTS)
+		return &still;
+
+	return &v->slot[tracking_id];
+}
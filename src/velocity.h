@@ -0,0 +1,55 @@
+/***************************************************************************
+ *
+ * Multitouch protocol X driver
+ * Copyright (C) 2008 Henrik Rydberg <rydberg@euromail.se>
+ * Copyright (C) 2009,2010 Nokia Corporation
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ **************************************************************************/
+
+#ifndef VELOCITY_H
+#define VELOCITY_H
+
+#include <sys/time.h>
+#include "hw.h"
+
+/* Velocity in device units per second, acceleration per second squared */
+#define VELOCITY_MAX     (1 << 24)
+#define ACCELERATION_MAX (1 << 30)
+
+struct mtev_velocity_slot {
+	bool valid;
+	bool seen;
+	int x, y;
+	struct timeval time;
+	int vx, vy;
+	int ax, ay;
+};
+
+/* Per contact motion history, indexed by tracking id */
+struct mtev_velocity {
+	struct mtev_velocity_slot slot[HW_MAX_CONTACTS];
+};
+
+void velocity_init(struct mtev_velocity *v);
+void velocity_begin_frame(struct mtev_velocity *v);
+void velocity_update(struct mtev_velocity *v, int tracking_id,
+		     int x, int y, const struct timeval *time);
+void velocity_end_frame(struct mtev_velocity *v);
+const struct mtev_velocity_slot* velocity_get(const struct mtev_velocity *v,
+					      int tracking_id);
+
+#endif